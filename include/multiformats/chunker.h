@@ -0,0 +1,64 @@
+#pragma once
+
+#include "multihash.h"
+#include "thread_pool.h"
+
+#include <functional>
+#include <vector>
+
+namespace multiformats {
+
+    //
+    // Chunking of a stream
+    //    A chunker returns the size of the next chunk at the start of data, or 0 if it needs more data.
+    //    When last is true, data is the end of the stream and the chunker must consume it.
+    //
+    using chunker_t = std::function<size_t(bufferview_t data, bool last)>;
+
+    inline chunker_t fixed_size_chunker(size_t size)
+    {
+        Expects(size > 0);
+        return [size](bufferview_t data, bool last) -> size_t {
+            auto available = static_cast<size_t>(data.size());
+            if (available >= size) return size;
+            return last ? available : 0;
+        };
+    }
+
+    // Bounds of the chunks of a content-defined chunker
+    //    avg is rounded down to a power of two.
+    struct chunk_sizes
+    {
+        size_t min = 64 * 1024;
+        size_t avg = 256 * 1024;
+        size_t max = 1024 * 1024;
+    };
+
+    // Content-defined chunkers: a boundary is placed where a rolling hash of the last bytes matches a mask,
+    // so that an edit only changes the chunks around it.
+
+    // FastCDC: gear rolling hash with normalized chunking (stricter mask before avg, looser after)
+    chunker_t fastcdc_chunker(chunk_sizes sizes = {});
+
+    // Rabin fingerprint over a 64-byte window, as in LBFS
+    chunker_t rabin_chunker(chunk_sizes sizes = {});
+
+
+    //
+    // Chunking and hashing of a content in memory (or memory-mapped)
+    //    The next chunk boundaries are searched while the chunks already found are hashed on the thread pool.
+    //
+    struct chunk
+    {
+        uint64_t offset;
+        size_t size;
+        multihash hash;
+    };
+
+    using chunk_callback = std::function<void(const chunk&)>;
+
+    // Report the chunks to on_chunk, in order
+    void compute_chunks(hash_t hash, bufferview_t content, const chunker_t& chunker, const chunk_callback& on_chunk, thread_pool& pool = default_thread_pool());
+
+    std::vector<chunk> compute_chunks(hash_t hash, bufferview_t content, const chunker_t& chunker, thread_pool& pool = default_thread_pool());
+}
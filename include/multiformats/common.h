@@ -3,6 +3,7 @@
 #include <gsl/gsl>
 #include <vector>
 #include <sstream>
+#include <cstring>
 
 namespace multiformats {
 
@@ -45,6 +46,127 @@ namespace multiformats {
     }
 
 
+    //
+    // Small raw memory buffer
+    //   Stores up to _Capacity bytes inline and only falls back to the heap for larger contents.
+    //   When the content fits inline, copies are plain memcpy and no allocation is ever made.
+    //
+    template <size_t _Capacity>
+    class small_buffer
+    {
+    public:
+        using value_type = byte_t;
+        using pointer = byte_t*;
+        using const_pointer = const byte_t*;
+        using iterator = const byte_t*;
+        using const_iterator = const byte_t*;
+
+        static constexpr size_t capacity = _Capacity;
+
+        // Construct empty
+        small_buffer() : _size(0) {}
+
+        // Construct by copying _Right
+        small_buffer(bufferview_t _Right) : _size(0) { assign(_Right); }
+        small_buffer(const small_buffer<_Capacity>& _Right) : _size(0) { assign(_Right); }
+
+        // Construct by moving _Right
+        small_buffer(small_buffer<_Capacity>&& _Right) noexcept : _size(_Right._size)
+        {
+            std::memcpy(_storage, _Right._storage, is_inline() ? _size : sizeof(byte_t*));
+            _Right._size = 0;
+        }
+
+        ~small_buffer() { release(); }
+
+        // Assign by copying _Right
+        small_buffer<_Capacity>& operator =(bufferview_t _Right)
+        {
+            assign(_Right);
+            return *this;
+        }
+        small_buffer<_Capacity>& operator =(const small_buffer<_Capacity>& _Right)
+        {
+            if (this != &_Right) assign(_Right);
+            return *this;
+        }
+
+        // Assign by moving _Right
+        small_buffer<_Capacity>& operator =(small_buffer<_Capacity>&& _Right) noexcept
+        {
+            if (this != &_Right) {
+                release();
+                _size = _Right._size;
+                std::memcpy(_storage, _Right._storage, is_inline() ? _size : sizeof(byte_t*));
+                _Right._size = 0;
+            }
+            return *this;
+        }
+
+        void assign(bufferview_t _Right)
+        {
+            const auto size = gsl::narrow<uint32_t>(_Right.size());
+            if (size > _Capacity) {
+                auto heap = new byte_t[size];
+                std::copy(_Right.begin(), _Right.end(), heap);
+                release();
+                std::memcpy(_storage, &heap, sizeof(heap));
+            }
+            else if (is_inline()) {
+                // _Right may be a view of this buffer
+                if (size) std::memmove(_storage, _Right.data(), size);
+            }
+            else {
+                byte_t tmp[_Capacity];
+                std::copy(_Right.begin(), _Right.end(), tmp);
+                release();
+                std::copy(tmp, tmp + size, _storage);
+            }
+            _size = size;
+        }
+
+        // Replace the content by size uninitialized bytes and return a pointer to them
+        byte_t* allocate(size_t size)
+        {
+            const auto newsize = gsl::narrow<uint32_t>(size);
+            auto heap = (newsize > _Capacity) ? new byte_t[newsize] : nullptr;
+            release();
+            _size = newsize;
+            if (heap) std::memcpy(_storage, &heap, sizeof(heap));
+            return data();
+        }
+
+        // Accessors
+        byte_t*       data()        { return is_inline() ? _storage : heap(); }
+        const byte_t* data()  const { return is_inline() ? _storage : heap(); }
+        size_t        size()  const { return _size; }
+        bool          empty() const { return _size == 0; }
+        const byte_t* begin() const { return data(); }
+        const byte_t* end()   const { return data() + _size; }
+
+        bool is_inline() const { return _size <= _Capacity; }
+
+    private:
+        // The heap pointer is kept unaligned in the inline storage, so that the buffer is not padded
+        byte_t* heap() const
+        {
+            auto ptr = static_cast<byte_t*>(nullptr);
+            std::memcpy(&ptr, _storage, sizeof(ptr));
+            return ptr;
+        }
+
+        void release()
+        {
+            if (!is_inline()) delete[] heap();
+            _size = 0;
+        }
+
+        static_assert(_Capacity >= sizeof(byte_t*), "small_buffer capacity must hold a pointer");
+
+        byte_t   _storage[_Capacity];
+        uint32_t _size;
+    };
+
     //
     // String and constant view of strings
     //
@@ -82,4 +204,11 @@ namespace multiformats {
     inline stringview_t as_string(bufferview_t b) { return { reinterpret_cast<const char*>(b.data()), b.size() }; }
     
     inline string_t to_string(bufferview_t b) { return to_string(as_string(b)); }
+
+
+    namespace details {
+        // Tag of the constructors that take a content that has already been verified
+        struct verified_t {};
+        constexpr verified_t verified{};
+    }
 }
\ No newline at end of file
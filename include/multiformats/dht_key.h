@@ -0,0 +1,129 @@
+#pragma once
+
+#include "multihash.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace multiformats {
+
+    //
+    // A 256-bit key of a Kademlia key space
+    //    Stored as 4 words, most significant first, so that the XOR distance and the ordering of keys
+    //    are computed a word at a time instead of byte by byte.
+    //
+    class dht_key
+    {
+    public:
+        static constexpr size_t size = 32;
+
+        dht_key() : _words{} {}
+
+        // Key of a multihash: the sha2-256 digest of the binary multihash, as in libp2p
+        explicit dht_key(const multihash_view& mh) : dht_key(from_digest(compute_digest(sha2_256, mh.data()).data())) {}
+        explicit dht_key(const multihash& mh) : dht_key(mh.view()) {}
+
+        // Key made of a 32-byte digest as is
+        static dht_key from_digest(bufferview_t digest)
+        {
+            Expects(digest.size() == size);
+            auto key = dht_key{};
+            for (auto i = 0; i < 4; i++) {
+                auto word = uint64_t{ 0 };
+                for (auto j = 0; j < 8; j++) word = (word << 8) | digest[8 * i + j];
+                key._words[i] = word;
+            }
+            return key;
+        }
+
+        const uint64_t* words() const { return _words; }
+
+        buffer_t bytes() const
+        {
+            auto out = buffer_t(size);
+            for (auto i = 0; i < 32; i++) out[i] = static_cast<byte_t>(_words[i / 8] >> (56 - 8 * (i % 8)));
+            return out;
+        }
+
+        // XOR distance
+        friend dht_key operator^(const dht_key& _Left, const dht_key& _Right)
+        {
+            auto d = dht_key{};
+            for (auto i = 0; i < 4; i++) d._words[i] = _Left._words[i] ^ _Right._words[i];
+            return d;
+        }
+
+        friend bool operator==(const dht_key& _Left, const dht_key& _Right)
+        {
+            return ((_Left._words[0] ^ _Right._words[0]) | (_Left._words[1] ^ _Right._words[1])
+                  | (_Left._words[2] ^ _Right._words[2]) | (_Left._words[3] ^ _Right._words[3])) == 0;
+        }
+        friend bool operator!=(const dht_key& _Left, const dht_key& _Right) { return !(_Left == _Right); }
+        friend bool operator< (const dht_key& _Left, const dht_key& _Right)
+        {
+            return std::lexicographical_compare(_Left._words, _Left._words + 4, _Right._words, _Right._words + 4);
+        }
+
+    private:
+        uint64_t _words[4];
+    };
+
+
+    namespace details {
+
+        // Number of leading zero bits of a non-zero word
+        inline int leading_zeros(uint64_t word)
+        {
+            auto n = 0;
+            for (auto shift = 32; shift; shift >>= 1)
+                if (!(word >> (64 - shift))) { n += shift; word <<= shift; }
+            return n;
+        }
+    }
+
+    // Number of leading bits shared by two keys (256 for equal keys), i.e. the index of their k-bucket
+    inline int common_prefix_length(const dht_key& _Left, const dht_key& _Right)
+    {
+        auto d = _Left ^ _Right;
+        for (auto i = 0; i < 4; i++)
+            if (d.words()[i]) return 64 * i + details::leading_zeros(d.words()[i]);
+        return 256;
+    }
+
+    // True if a is closer to target than b
+    inline bool closer(const dht_key& target, const dht_key& a, const dht_key& b)
+    {
+        return (a ^ target) < (b ^ target);
+    }
+
+    // Indices of the k candidates closest to target, from the closest
+    //    The distances are computed once; nth_element selects the k closest in linear time and only those are sorted.
+    inline std::vector<size_t> closest(const dht_key& target, gsl::span<const dht_key> candidates, size_t k)
+    {
+        const auto count = static_cast<size_t>(candidates.size());
+        k = std::min(k, count);
+
+        auto distances = std::vector<std::pair<dht_key, size_t>>{};
+        distances.reserve(count);
+        for (size_t i = 0; i < count; i++)
+            distances.emplace_back(candidates[i] ^ target, i);
+
+        auto by_distance = [](const std::pair<dht_key, size_t>& a, const std::pair<dht_key, size_t>& b) { return a.first < b.first; };
+        if (k < count) std::nth_element(distances.begin(), distances.begin() + k, distances.end(), by_distance);
+        std::sort(distances.begin(), distances.begin() + k, by_distance);
+
+        auto result = std::vector<size_t>(k);
+        for (size_t i = 0; i < k; i++) result[i] = distances[i].second;
+        return result;
+    }
+}
+
+
+namespace std {
+
+    template <>
+    struct hash<multiformats::dht_key>
+    {
+        size_t operator()(const multiformats::dht_key& key) const { return static_cast<size_t>(key.words()[0]); }
+    };
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "chunker.h"
+#include "multihash.h"
+#include "thread_pool.h"
+
+#include <functional>
+#include <vector>
+
+namespace multiformats {
+
+    //
+    // A node of a Merkle DAG
+    //    A leaf is the multihash of a chunk. A parent is the multihash of the concatenation of the binary
+    //    multihashes of its children.
+    //
+    struct merkle_node
+    {
+        const multihash& hash;
+        int level;                              // 0 for leaves
+        uint64_t offset;                        // first byte of content covered by the node
+        uint64_t size;                          // number of bytes of content covered by the node
+        gsl::span<const multihash> children;    // empty for leaves
+    };
+
+    //
+    // Streaming builder of a balanced Merkle DAG
+    //    Content is buffered up to a batch of chunks, whose leaves are hashed in parallel; parents are built as soon as
+    //    a level has fanout nodes. Memory is bounded by the batch, the largest chunk and fanout nodes per level.
+    //    Each node is reported to the callback once, children before their parent.
+    //
+    class merkle_builder
+    {
+    public:
+        using callback_t = std::function<void(const merkle_node&)>;
+
+        merkle_builder(hash_t hash, chunker_t chunker, size_t fanout = 174, callback_t on_node = {}, thread_pool& pool = default_thread_pool());
+
+        // Append content
+        void update(bufferview_t data);
+
+        // Flush the content and the incomplete levels, and return the root
+        //    A content made of a single chunk has its leaf as root.
+        multihash final();
+
+        size_t buffered() const { return _pending.size(); }
+
+    private:
+        struct level_t {
+            std::vector<multihash> nodes;
+            uint64_t offset = 0;
+            uint64_t size = 0;
+        };
+
+        void process(bool last);
+        void push(size_t level, multihash&& node, uint64_t size);
+        void reduce(size_t level);
+
+        const hash_t _hash;
+        const chunker_t _chunker;
+        const size_t _fanout;
+        const callback_t _on_node;
+        thread_pool& _pool;
+        const size_t _batch_size;
+
+        buffer_t _pending;
+        uint64_t _offset = 0;
+        std::vector<level_t> _levels;
+    };
+
+    // Build the Merkle DAG of a content in memory and return its root
+    multihash compute_merkle_root(hash_t hash, bufferview_t content, chunker_t chunker, size_t fanout = 174, thread_pool& pool = default_thread_pool());
+}
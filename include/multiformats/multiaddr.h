@@ -36,45 +36,76 @@ namespace multiformats {
     };
 namespace details {
 
-    typedef stringview_t(*Serializer)(stringview_t, buffer_t&);
-    typedef bufferview_t(*Deserializer)(bufferview_t, std::string&);
-    typedef bufferview_t(*Reader)(bufferview_t, buffer_t&);
+    // Output of the serializers: a bounded byte range that records an overflow instead of writing past its end
+    struct addr_writer
+    {
+        byte_t* first;
+        byte_t* out;
+        byte_t* end;
+        bool    overflow;
+
+        addr_writer(byte_t* data, size_t size) : first(data), out(data), end(data + size), overflow(false) {}
+
+        void put(byte_t b)
+        {
+            if (out == end) overflow = true;
+            else *out++ = b;
+        }
+        void put(bufferview_t b)
+        {
+            for (auto c : b) put(c);
+        }
+        void put_uvarint(uint64_t value)
+        {
+            byte_t tmp[uvarint::max_varint_size];
+            put({ tmp, uvarint::encode(value, tmp) });
+        }
 
-    inline stringview_t serialize_noimpl(stringview_t /*src*/, buffer_t& /*dst*/) { throw std::logic_error("Function not yet implemented"); }
-    inline bufferview_t deserialize_noimpl(bufferview_t /*src*/, std::string& /*dst*/) { throw std::logic_error("Function not yet implemented"); }
-    inline bufferview_t read_noimpl(bufferview_t /*src*/, buffer_t& /*dst*/) { throw std::logic_error("Function not yet implemented"); }
+        size_t size() const { return static_cast<size_t>(out - first); }
+    };
+
+    // A serializer parses the value at the head of [first, last) and appends its binary form to dst.
+    //    It returns the end of the value; on error, it sets error and returns the position of the error.
+    typedef const char*(*Serializer)(const char* first, const char* last, addr_writer& dst, const char*& error);
+    // A deserializer writes the string form of a binary value to dst, unless dst is null, and returns its length
+    typedef size_t(*Deserializer)(bufferview_t value, char* dst);
+    typedef bufferview_t(*Reader)(bufferview_t, bufferview_t&);
+
+    inline const char* serialize_noimpl(const char* first, const char* /*last*/, addr_writer& /*dst*/, const char*& error) { error = "protocol not implemented"; return first; }
+    inline size_t deserialize_noimpl(bufferview_t /*value*/, char* /*dst*/) { throw std::logic_error("Function not yet implemented"); }
+    inline bufferview_t read_noimpl(bufferview_t /*src*/, bufferview_t& /*value*/) { throw std::logic_error("Function not yet implemented"); }
 
-    inline stringview_t serialize_noval(stringview_t src, buffer_t& /*dst*/) { return src; }
-    inline bufferview_t deserialize_noval(bufferview_t src, std::string& /*dst*/) { return src; }
-    inline bufferview_t read_noval(bufferview_t src, buffer_t& /*dst*/) { return src; }
+    inline const char* serialize_noval(const char* first, const char* /*last*/, addr_writer& /*dst*/, const char*& /*error*/) { return first; }
+    inline size_t deserialize_noval(bufferview_t /*value*/, char* /*dst*/) { return 0; }
+    inline bufferview_t read_noval(bufferview_t src, bufferview_t& value) { value = src.first(0); return src; }
 
-    stringview_t serialize_ipv4(stringview_t src, buffer_t& dst);
-    bufferview_t deserialize_ipv4(bufferview_t src, std::string& dst);
-    bufferview_t read_ipv4(bufferview_t src, buffer_t& dst);
+    const char* serialize_ipv4(const char* first, const char* last, addr_writer& dst, const char*& error);
+    size_t deserialize_ipv4(bufferview_t value, char* dst);
+    bufferview_t read_ipv4(bufferview_t src, bufferview_t& value);
 
-    stringview_t serialize_ipv6(stringview_t src, buffer_t& dst);
-    bufferview_t deserialize_ipv6(bufferview_t src, std::string& dst);
-    bufferview_t read_ipv6(bufferview_t src, buffer_t& dst);
+    const char* serialize_ipv6(const char* first, const char* last, addr_writer& dst, const char*& error);
+    size_t deserialize_ipv6(bufferview_t value, char* dst);
+    bufferview_t read_ipv6(bufferview_t src, bufferview_t& value);
 
-    stringview_t serialize_dns(stringview_t src, buffer_t& dst);
-    bufferview_t deserialize_dns(bufferview_t src, std::string& dst);
-    bufferview_t read_dns(bufferview_t src, buffer_t& dst);
+    const char* serialize_dns(const char* first, const char* last, addr_writer& dst, const char*& error);
+    size_t deserialize_dns(bufferview_t value, char* dst);
+    bufferview_t read_dns(bufferview_t src, bufferview_t& value);
 
-    stringview_t serialize_ipfs(stringview_t src, buffer_t& dst);
-    bufferview_t deserialize_ipfs(bufferview_t src, std::string& dst);
-    bufferview_t read_ipfs(bufferview_t src, buffer_t& dst);
+    const char* serialize_ipfs(const char* first, const char* last, addr_writer& dst, const char*& error);
+    size_t deserialize_ipfs(bufferview_t value, char* dst);
+    bufferview_t read_ipfs(bufferview_t src, bufferview_t& value);
 
-    stringview_t serialize_onion(stringview_t src, buffer_t& dst);
-    bufferview_t deserialize_onion(bufferview_t src, std::string& dst);
-    bufferview_t read_onion(bufferview_t src, buffer_t& dst);
+    const char* serialize_onion(const char* first, const char* last, addr_writer& dst, const char*& error);
+    size_t deserialize_onion(bufferview_t value, char* dst);
+    bufferview_t read_onion(bufferview_t src, bufferview_t& value);
 
-    stringview_t serialize_unix(stringview_t src, buffer_t& dst);
-    bufferview_t deserialize_unix(bufferview_t src, std::string& dst);
-    bufferview_t read_unix(bufferview_t src, buffer_t& dst);
+    const char* serialize_unix(const char* first, const char* last, addr_writer& dst, const char*& error);
+    size_t deserialize_unix(bufferview_t value, char* dst);
+    bufferview_t read_unix(bufferview_t src, bufferview_t& value);
 
-    stringview_t serialize_port(stringview_t src, buffer_t& dst);
-    bufferview_t deserialize_port(bufferview_t src, std::string& dst);
-    bufferview_t read_port(bufferview_t src, buffer_t& dst);
+    const char* serialize_port(const char* first, const char* last, addr_writer& dst, const char*& error);
+    size_t deserialize_port(bufferview_t value, char* dst);
+    bufferview_t read_port(bufferview_t src, bufferview_t& value);
 
 
     struct addrimpl {
@@ -84,7 +115,7 @@ namespace details {
         int32_t      len;
         Serializer   serialize;
         Deserializer deserialize;
-        Reader       read;
+        Reader       read;          // splits the binary value at the head of src
     };
 
     // defined protocols from https://github.com/multiformats/multiaddr/blob/master/protocols.csv
@@ -122,17 +153,90 @@ namespace details {
             if (_AddrTable[i].key == key) return i;
         return 0;
     }
+
+    // The automata of multiaddr_pattern index their transitions by addr_t, as well as by table index
+    constexpr bool addr_table_in_key_order() {
+        for (auto i = 0; i < _countof(_AddrTable); i++)
+            if (_AddrTable[i].key != i) return false;
+        return true;
+    }
+    static_assert(addr_table_in_key_order(), "The protocols of _AddrTable must be in the order of addr_t");
     
+
+    // Lookup of a protocol by name: a perfect hash of the names into 64 slots
+    //    If a new name collides, pick another seed so that the static_assert below holds.
+    constexpr uint32_t addr_name_seed = 6179;
+    constexpr int addr_name_bits = 6;
+
+    constexpr size_t addr_name_hash(const char* name, size_t len)
+    {
+        auto h = uint32_t{ 2166136261u ^ addr_name_seed };
+        for (size_t i = 0; i < len; i++) h = (h ^ static_cast<uint8_t>(name[i])) * 16777619u;
+        return h >> (32 - addr_name_bits);
+    }
+
+    constexpr size_t addr_name_length(const char* name)
+    {
+        auto len = size_t{ 0 };
+        while (name[len]) len++;
+        return len;
+    }
+
+    struct addr_name_index
+    {
+        uint8_t slot[1 << addr_name_bits];
+        uint8_t length[_countof(_AddrTable)];
+        bool    perfect;
+
+        constexpr addr_name_index() : slot{}, length{}, perfect(true)
+        {
+            for (size_t i = 1; i < _countof(_AddrTable); i++) {
+                length[i] = static_cast<uint8_t>(addr_name_length(_AddrTable[i].name));
+                auto& s = slot[addr_name_hash(_AddrTable[i].name, length[i])];
+                if (s != 0) perfect = false;
+                s = static_cast<uint8_t>(i);
+            }
+        }
+    };
+    constexpr addr_name_index _AddrNameIndex{};
+    static_assert(_AddrNameIndex.perfect, "The protocol names collide in addr_name_index: change addr_name_seed");
+
+    // Lookup of a protocol by code: a direct table
+    constexpr uint32_t max_direct_addr_code = 512;
+
+    struct addr_code_index
+    {
+        uint8_t slot[max_direct_addr_code];
+        bool    direct;
+
+        constexpr addr_code_index() : slot{}, direct(true)
+        {
+            for (size_t i = 1; i < _countof(_AddrTable); i++) {
+                if (_AddrTable[i].code >= max_direct_addr_code) direct = false;
+                else slot[_AddrTable[i].code] = static_cast<uint8_t>(i);
+            }
+        }
+    };
+    constexpr addr_code_index _AddrCodeIndex{};
+    static_assert(_AddrCodeIndex.direct, "A protocol code does not fit in addr_code_index: increase max_direct_addr_code");
+
     inline int find_addrimpl_by_name(stringview_t name) {
-        auto s = to_string(name);
-        for (auto i = 0; i < _countof(_AddrTable); i++)
-            if (_AddrTable[i].name == s) return i;
-        return 0;
+        const auto len = static_cast<size_t>(name.size());
+        const auto i = _AddrNameIndex.slot[addr_name_hash(name.data(), len)];
+        if (i == 0 || _AddrNameIndex.length[i] != len || std::memcmp(_AddrTable[i].name, name.data(), len) != 0) return 0;
+        return i;
     }
     inline int find_addrimpl_by_code(uint32_t code) {
-        for (auto i = 0; i < _countof(_AddrTable); i++)
-            if (_AddrTable[i].code == code) return i;
-        return 0;
+        return code < max_direct_addr_code ? _AddrCodeIndex.slot[code] : 0;
+    }
+
+    // Lexicographic order of byte strings, a prefix first: <0, 0 or >0 as memcmp
+    inline int compare_binary(bufferview_t _Left, bufferview_t _Right)
+    {
+        const auto n = static_cast<size_t>(std::min(_Left.size(), _Right.size()));
+        const auto c = n ? std::memcmp(_Left.data(), _Right.data(), n) : 0;
+        if (c != 0) return c;
+        return _Left.size() < _Right.size() ? -1 : _Left.size() > _Right.size() ? 1 : 0;
     }
 
 
@@ -184,28 +288,22 @@ namespace details {
         addr_buffer(bufferview_t _Right) : _addr(_Addr)
         {
             static_assert(_Addr != dynamic_addr, "dynamic_addr is not allowed here");
-            _addr.read()(_Right, _buffer);
-            Expects(_addr.len() < 0 || _buffer.size() == _addr.len());
+            read(_Right);
         }
         addr_buffer(addr_t addr, bufferview_t _Right) : _addr(addr)
         {
-            _addr.read()(_Right, _buffer);
-            Expects(_addr.len() < 0 || _buffer.size() == _addr.len());
+            read(_Right);
         }
 
         //    - from std::string
         addr_buffer(stringview_t _Right) : _addr(_Addr)
         {
             static_assert(_Addr != dynamic_addr, "dynamic_addr is not allowed here");
-            Expects(!_Right.empty());
-            _addr.serialize()(_Right, _buffer);
-            Expects(_addr.len() < 0 || _buffer.size() == _addr.len());
+            serialize(_Right);
         }
         addr_buffer(addr_t addr, stringview_t _Right) : _addr(addr)
         {
-            Expects(!_Right.empty());
-            _addr.serialize()(_Right, _buffer);
-            Expects(_addr.len() < 0 || _buffer.size() == _addr.len());
+            serialize(_Right);
         }
 
         addr_buffer(const char* _Right) : addr_buffer(gsl::ensure_z(_Right))
@@ -245,14 +343,38 @@ namespace details {
 
         // Accessors
         addr_t       addr() const { return _addr.key(); }
+        uint32_t     code() const { return _addr.code(); }
         bufferview_t data() const { return _buffer; }
         string_t     str()  const {
-            auto s = string_t{};
-            _addr.deserialize()(_buffer, s);
+            auto s = string_t(_addr.deserialize()(_buffer, nullptr), '\0');
+            _addr.deserialize()(_buffer, &s[0]);
             return s;
         }
 
     private:
+        void serialize(stringview_t _Right)
+        {
+            Expects(!_Right.empty());
+
+            // a binary value is at most 16 bytes plus a length prefix longer than its string
+            _buffer.resize(_Right.size() + 16);
+            auto dst = details::addr_writer{ _buffer.data(), _buffer.size() };
+            auto error = static_cast<const char*>(nullptr);
+            _addr.serialize()(_Right.data(), _Right.data() + _Right.size(), dst, error);
+            if (error) throw std::invalid_argument(std::string{ "Invalid " } + _addr.name() + " value: " + error);
+            Expects(!dst.overflow);
+            _buffer.resize(dst.size());
+            Expects(_addr.len() < 0 || _buffer.size() == _addr.len());
+        }
+
+        void read(bufferview_t _Right)
+        {
+            auto value = bufferview_t{};
+            _addr.read()(_Right, value);
+            _buffer.assign(value.begin(), value.end());
+            Expects(_addr.len() < 0 || _buffer.size() == _addr.len());
+        }
+
         const details::addr_type<_Addr> _addr;
         buffer_t _buffer;
 
@@ -275,139 +397,421 @@ namespace details {
     
     template <addr_t _LeftAddr, addr_t _RightAddr>
     bool operator<(const addr_buffer<_LeftAddr>& _Left, const addr_buffer<_RightAddr>& _Right) {
-        if (_Left.addr() < _Right.addr()) return true;
-        if (_Left.addr() > _Right.addr()) return false;
-        auto minsize = std::min(_Left.data().size(), _Right.data().size());
-        for (auto i = 0; i < minsize; i++) {
-            if (_Left.data()[i] < _Right.data()[i]) return true;
-            if (_Left.data()[i] > _Right.data()[i]) return false;
-        }
-        return false;
+        if (_Left.addr() != _Right.addr()) return _Left.addr() < _Right.addr();
+        return details::compare_binary(_Left.data(), _Right.data()) < 0;
     }
 
 
 
-    class multiaddr
+    //
+    // A component of a multiaddr: a protocol and a view of its binary value
+    //
+    class addr_view
     {
-        using store_t = std::vector<addr_buffer<>>;
-
     public:
-        // Construct empty
-        multiaddr() {}
+        addr_view(int index, bufferview_t value) : _index(index), _value(value)
+        { }
 
-        // Construct by parsing _Right
-        //    - from stringview_t
-        multiaddr(stringview_t _Right)
+        // Accessors
+        addr_t       addr() const { return details::_AddrTable[_index].key; }
+        const char*  name() const { return details::_AddrTable[_index].name; }
+        uint32_t     code() const { return details::_AddrTable[_index].code; }
+        bufferview_t data() const { return _value; }
+        string_t     str()  const {
+            const auto deserialize = details::_AddrTable[_index].deserialize;
+            auto s = string_t(deserialize(_value, nullptr), '\0');
+            deserialize(_value, &s[0]);
+            return s;
+        }
+
+        // Write "/name/value" (or "/name" without value) to dst, unless dst is null, and return its length
+        size_t format(char* dst) const
         {
-            auto view = _Right;
+            const auto& impl = details::_AddrTable[_index];
+            const auto name = details::_AddrNameIndex.length[_index];
+            if (dst) {
+                *dst++ = '/';
+                std::memcpy(dst, impl.name, name);
+                dst += name;
+            }
+            if (impl.len == 0) return 1 + name;
 
-            while (!view.empty()) {
-                // extract separator
-                if (view[0] != '/') throw std::invalid_argument("Invalid multiaddr format: a protocol must follow a '/'");
-                view = view.last(view.size() - 1);
+            if (dst) *dst++ = '/';
+            return 2 + name + impl.deserialize(_value, dst);
+        }
 
-                // a trailing / is valid
-                if (view.empty()) break;
+        // Copy to an addr_buffer
+        operator addr_buffer<>() const { return { addr(), _value }; }
 
-                // find next separator
-                auto pos = std::find(view.begin(), view.end(), '/') - view.begin();
-                //if (pos == view.size()) throw std::invalid_argument("Invalid multiaddr format: No protocol found");
+    private:
+        int _index;
+        bufferview_t _value;
+    };
 
-                // extract protocol name
-                auto protocol = view.first(pos);
-                view = view.last(view.size() - pos);
+    // Comparison operators
+    inline bool operator==(const addr_view& _Left, const addr_view& _Right)
+    {
+        return (_Left.addr() == _Right.addr()) && (_Left.data() == _Right.data());
+    }
 
-                auto index = details::find_addrimpl_by_name(protocol);
-                if (index == 0) throw std::invalid_argument("Invalid multiaddr format: unsupported protocol " + to_string(protocol));
+    inline bool operator!=(const addr_view& _Left, const addr_view& _Right)
+    {
+        return !(_Left == _Right);
+    }
 
-                auto value = buffer_t{};
-                if (details::_AddrTable[index].len != 0)
-                {
-                    // extract separator
-                    if (view[0] != '/') throw std::invalid_argument("Invalid multiaddr format: a value must follow a '/'");
-                    view = view.last(view.size() - 1);
+    inline bool operator<(const addr_view& _Left, const addr_view& _Right)
+    {
+        if (_Left.addr() != _Right.addr()) return _Left.addr() < _Right.addr();
+        return details::compare_binary(_Left.data(), _Right.data()) < 0;
+    }
 
-                    // serialize 
-                    view = details::_AddrTable[index].serialize(view, value);
-                }
+namespace details {
+
+    // Write the string form of a range of addr_view to dst, unless dst is null, and return its length
+    template <class _Range>
+    size_t format_components(const _Range& components, char* dst)
+    {
+        auto length = size_t{ 0 };
+        for (auto a : components) length += a.format(dst ? dst + length : nullptr);
+
+        // the empty address is "/"
+        if (length == 0) {
+            if (dst) *dst = '/';
+            length = 1;
+        }
+        return length;
+    }
+
+    template <class _Range>
+    string_t format_string(const _Range& components)
+    {
+        auto s = string_t(format_components(components, nullptr), '\0');
+        format_components(components, &s[0]);
+        return s;
+    }
+
+    // Split the component at the head of a binary multiaddr, and return the rest
+    inline bufferview_t read_component(bufferview_t src, int& index, bufferview_t& value)
+    {
+        uint32_t protocol;
+        auto view = uvarint::decode(src, &protocol);
+
+        index = find_addrimpl_by_code(protocol);
+        if (index == 0) throw std::invalid_argument("Invalid multiaddr format: unsupported protocol");
+
+        view = _AddrTable[index].read(view, value);
+        if (_AddrTable[index].len >= 0 && value.size() != _AddrTable[index].len) throw std::invalid_argument("Invalid multiaddr format: wrong value size");
+        return view;
+    }
+
+    // Hash of a binary multiaddr, read by words since the binary forms are a few words long
+    inline uint64_t hash_binary(bufferview_t data)
+    {
+        const auto p = data.data();
+        const auto n = static_cast<size_t>(data.size());
+        auto mix = [](uint64_t h, uint64_t w) { h = (h ^ w) * 0xBF58476D1CE4E5B9ULL; return h ^ (h >> 29); };
+
+        auto h = 0x9E3779B97F4A7C15ULL ^ n;
+        auto i = size_t{ 0 };
+        for (; i + 8 <= n; i += 8) {
+            uint64_t w;
+            std::memcpy(&w, p + i, sizeof(w));
+            h = mix(h, w);
+        }
+        if (i < n) {
+            auto w = uint64_t{ 0 };
+            std::memcpy(&w, p + i, n - i);
+            h = mix(h, w);
+        }
+        h = (h ^ (h >> 32)) * 0x94D049BB133111EBULL;
+        return h ^ (h >> 29);
+    }
+
+}
+
+
+    //
+    // Parsing of the string form of a multiaddr into its binary form, without allocation
+    //
+    struct multiaddr_parse_result
+    {
+        size_t      size;       // number of bytes written
+        const char* error;      // nullptr on success
+        size_t      position;   // position of the error in the string
+
+        explicit operator bool() const { return error == nullptr; }
+    };
+
+    // A binary form is at most 3 bytes per character of its string form ("/ip6/::" is 17 bytes)
+    constexpr size_t max_multiaddr_size(size_t length) { return 3 * length; }
 
-                // create a new addr_buffer
-                auto addr = addr_buffer<>(details::_AddrTable[index].key, value);
-                _protocols.push_back(addr);
+    multiaddr_parse_result parse_multiaddr(stringview_t src, gsl::span<byte_t> dst);
+
+
+    //
+    // A non-owning view of a binary multiaddr
+    //    The buffer is validated once at construction and must outlive the view. Components are decoded lazily.
+    //
+    class multiaddr_view
+    {
+    public:
+        class const_iterator
+        {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = addr_view;
+            using difference_type = ptrdiff_t;
+            using pointer = void;
+            using reference = addr_view;
+
+            explicit const_iterator(bufferview_t rest) : _rest(rest)
+            {
+                if (!_rest.empty()) _next = details::read_component(_rest, _index, _value);
+            }
+
+            addr_view operator*() const { return { _index, _value }; }
+
+            const_iterator& operator++() { *this = const_iterator{ _next }; return *this; }
+            const_iterator  operator++(int) { auto it = *this; ++*this; return it; }
+
+            // iterators of a view differ by the number of bytes left
+            bool operator==(const const_iterator& _Right) const { return _rest.size() == _Right._rest.size(); }
+            bool operator!=(const const_iterator& _Right) const { return !(*this == _Right); }
+
+        private:
+            bufferview_t _rest;
+            bufferview_t _next;
+            int _index = 0;
+            bufferview_t _value;
+        };
+        using iterator = const_iterator;
+
+        // Construct empty
+        multiaddr_view() {}
+
+        // Construct by validating _Right
+        explicit multiaddr_view(bufferview_t _Right) : _data(_Right)
+        {
+            for (auto view = _Right; !view.empty(); ) {
+                auto index = 0;
+                auto value = bufferview_t{};
+                view = details::read_component(view, index, value);
             }
         }
-        multiaddr(const char* _Right) : multiaddr(gsl::ensure_z(_Right))
+
+        const_iterator begin() const { return const_iterator{ _data }; }
+        const_iterator end()   const { return const_iterator{ _data.last(0) }; }
+
+        // Find the first component of a protocol
+        const_iterator find(addr_t protocol) const
+        {
+            return std::find_if(begin(), end(), [&](const addr_view& a) { return a.addr() == protocol; });
+        }
+        bool has(addr_t protocol) const { return find(protocol) != end(); }
+
+        // The prefix before the last component of a protocol, or before the last occurrence of _Right, as a view
+        // of the same bytes (the whole address if there is none)
+        multiaddr_view decapsulate(addr_t protocol) const
+        {
+            return prefix([&](bufferview_t, int index) { return details::_AddrTable[index].key == protocol; });
+        }
+        multiaddr_view decapsulate(const multiaddr_view& _Right) const
+        {
+            const auto pattern = _Right.data();
+            if (pattern.empty()) return *this;
+            return prefix([&](bufferview_t rest, int) { return rest.size() >= pattern.size() && rest.first(pattern.size()) == pattern; });
+        }
+
+        // Accessors
+        bool         empty() const { return _data.empty(); }
+        size_t       size()  const { return static_cast<size_t>(std::distance(begin(), end())); }
+        bufferview_t data()  const { return _data; }
+
+        // String form
+        //    format() writes to dst, which must hold str_length() characters, and returns that length.
+        size_t   str_length()                 const { return details::format_components(*this, nullptr); }
+        size_t   format(gsl::span<char> dst)  const { Expects(static_cast<size_t>(dst.size()) >= str_length()); return details::format_components(*this, dst.data()); }
+        string_t str()                        const { return details::format_string(*this); }
+
+    private:
+        // Construct from an already validated buffer
+        multiaddr_view(bufferview_t _Right, details::verified_t) : _data(_Right)
         { }
 
-        //    - from bufferview_t
-        multiaddr(bufferview_t _Right)
+        // The prefix before the last component where cut(rest of the address, protocol index) holds
+        template <class _Cut>
+        multiaddr_view prefix(_Cut cut) const
         {
-            auto view = _Right;
+            auto end = _data.size();
+            for (auto rest = _data; !rest.empty(); ) {
+                auto index = 0;
+                auto value = bufferview_t{};
+                auto next = details::read_component(rest, index, value);
+                if (cut(rest, index)) end = _data.size() - rest.size();
+                rest = next;
+            }
+            return { _data.first(end), details::verified };
+        }
+
+        bufferview_t _data;
+
+        friend class multiaddr;
+        friend class multiaddr_pool;
+    };
+
+    inline bool operator==(const multiaddr_view& _Left, const multiaddr_view& _Right)
+    {
+        return _Left.data() == _Right.data();
+    }
 
-            while (!view.empty()) {
+    inline bool operator!=(const multiaddr_view& _Left, const multiaddr_view& _Right)
+    {
+        return !(_Left == _Right);
+    }
 
-                // extract protocol
-                uint32_t protocol;
-                view = uvarint::decode(view, &protocol);
+    // Order of the binary forms, where an address comes before its encapsulations
+    inline bool operator<(const multiaddr_view& _Left, const multiaddr_view& _Right)
+    {
+        return details::compare_binary(_Left.data(), _Right.data()) < 0;
+    }
 
-                // find protocol index
-                auto index = details::find_addrimpl_by_code(protocol);
-                if (index == 0) throw std::invalid_argument("Invalid multiaddr format: unsupported protocol");
 
-                // extract value
-                auto value = buffer_t{};
-                view = details::_AddrTable[index].read(view, value);
+    //
+    // Multiaddr
+    //    The address is stored as its binary form, preceded by the end offset of each component, in a single buffer
+    //    that is inline for most addresses. Components are iterated as addr_view.
+    //
+    class multiaddr
+    {
+    public:
+        class const_iterator
+        {
+        public:
+            using iterator_category = std::random_access_iterator_tag;
+            using value_type = addr_view;
+            using difference_type = ptrdiff_t;
+            using pointer = void;
+            using reference = addr_view;
+
+            const_iterator(const multiaddr* ma, size_t i) : _ma(ma), _i(i) {}
+
+            addr_view operator*() const { return (*_ma)[_i]; }
+
+            const_iterator& operator++() { ++_i; return *this; }
+            const_iterator  operator++(int) { auto it = *this; ++_i; return it; }
+            const_iterator& operator--() { --_i; return *this; }
+            const_iterator  operator--(int) { auto it = *this; --_i; return it; }
+            const_iterator& operator+=(difference_type n) { _i += n; return *this; }
+            const_iterator& operator-=(difference_type n) { _i -= n; return *this; }
+            const_iterator  operator+(difference_type n) const { return { _ma, _i + n }; }
+            const_iterator  operator-(difference_type n) const { return { _ma, _i - n }; }
+            difference_type operator-(const const_iterator& _Right) const { return static_cast<difference_type>(_i - _Right._i); }
+            addr_view       operator[](difference_type n) const { return (*_ma)[_i + n]; }
+
+            bool operator==(const const_iterator& _Right) const { return _i == _Right._i; }
+            bool operator!=(const const_iterator& _Right) const { return _i != _Right._i; }
+            bool operator<(const const_iterator& _Right) const { return _i < _Right._i; }
+
+        private:
+            const multiaddr* _ma;
+            size_t _i;
+        };
+        using iterator = const_iterator;
+
+        // Construct empty
+        multiaddr() {}
 
-                // create a new addr_buffer
-                auto addr = addr_buffer<>(details::_AddrTable[index].key, value);
-                _protocols.push_back(addr);
+        // Construct by parsing _Right
+        //    - from stringview_t
+        multiaddr(stringview_t _Right)
+        {
+            // parse on the stack, unless the string is long
+            byte_t local[512];
+            auto heap = buffer_t{};
+            auto dst = gsl::span<byte_t>{ local };
+            if (max_multiaddr_size(_Right.size()) > sizeof(local)) {
+                heap.resize(max_multiaddr_size(_Right.size()));
+                dst = heap;
             }
+
+            auto result = parse_multiaddr(_Right, dst);
+            if (!result) throw std::invalid_argument("Invalid multiaddr format: " + std::string{ result.error } + " at position " + std::to_string(result.position));
+            assign(dst.first(result.size));
+        }
+        multiaddr(const char* _Right) : multiaddr(gsl::ensure_z(_Right))
+        { }
+
+        //    - from bufferview_t
+        multiaddr(bufferview_t _Right)
+        {
+            assign(_Right);
+        }
+
+        //    - from multiaddr_view
+        explicit multiaddr(const multiaddr_view& _Right)
+        {
+            assign(_Right.data());
         }
 
         //    - from addr_buffer<A>
         template <addr_t _Addr>
-        multiaddr(const addr_buffer<_Addr>& _Right) : _protocols({_Right})
+        multiaddr(const addr_buffer<_Addr>& _Right) : multiaddr(&_Right, &_Right + 1)
         { }
 
-        multiaddr(const store_t& _Right) : _protocols(_Right)
+        //    - from a range of addr_buffer<> or addr_view
+        multiaddr(const std::vector<addr_buffer<>>& _Right) : multiaddr(_Right.begin(), _Right.end())
         { }
 
         template<class _Iter>
-        multiaddr(_Iter _First, _Iter _Last) : _protocols(_First, _Last)
-        { }
-
-        //    - from multiaddr
-        multiaddr(const multiaddr& _Right) : _protocols(_Right._protocols)
-        { }
+        multiaddr(_Iter _First, _Iter _Last)
+        {
+            auto binary = buffer_t{};
+            for (; _First != _Last; ++_First) {
+                const auto& component = *_First;
+                uvarint::encode(component.code(), std::back_inserter(binary));
+                binary += component.data();
+            }
+            assign(binary);
+        }
 
 
         //
         //
         multiaddr encapsulate(const multiaddr& _Right) const
         {
-            auto protocols = _protocols;
-            protocols.insert(protocols.end(), _Right._protocols.begin(), _Right._protocols.end());
-            return { protocols };
+            // both addresses are valid: their offsets and bytes are put together without parsing them again
+            if (_Right.empty()) return *this;
+            if (empty()) return _Right;
+
+            const auto left = data();
+            const auto right = _Right.data();
+            if (left.size() + right.size() > 0xFFFF) throw std::invalid_argument("Invalid multiaddr format: address too long");
+
+            const auto n = size();
+            const auto count = n + _Right.size();
+            auto result = multiaddr{};
+            auto words = result._store.allocate(2 * (count + 1) + left.size() + right.size());
+            put_word(words, 0, count);
+            std::memcpy(words + 2, _store.data() + 2, 2 * n);
+            for (size_t i = 1; i <= _Right.size(); i++) put_word(words, n + i, left.size() + _Right.word(i));
+
+            auto bytes = std::copy(left.begin(), left.end(), words + 2 * (count + 1));
+            std::copy(right.begin(), right.end(), bytes);
+            return result;
         }
         template <addr_t _Addr>
         multiaddr encapsulate(const addr_buffer<_Addr>& _Right) const 
         {
-            auto protocols = _protocols;
-            protocols.push_back(_Right);
-            return { protocols };
+            return encapsulate(multiaddr{ _Right });
         }
 
 
         multiaddr decapsulate(addr_t protocol) const
         {
-            auto rit = std::find_if(_protocols.rbegin(), _protocols.rend(), [&](auto a) { return a.addr() == protocol; });
-            if (rit == _protocols.rend()) return _protocols;
-
-            auto it = rit.base() - 1;
-
-            auto protocols = store_t{};
-            protocols.insert(protocols.begin(), _protocols.begin(), it);
-            return { protocols };
+            for (auto i = size(); i > 0; i--) {
+                if (this->protocol(i - 1) == protocol) return prefix(i - 1);
+            }
+            return *this;
         }
 
         template <addr_t _Addr>
@@ -418,57 +822,138 @@ namespace details {
 
         multiaddr decapsulate(const multiaddr& _Right) const
         {
-            auto it = std::find_end(_protocols.begin(), _protocols.end(), _Right._protocols.begin(), _Right._protocols.end());
-
-            auto protocols = store_t{};
-            protocols.insert(protocols.begin(), _protocols.begin(), it);
-            return { protocols };
+            // the binary form is self-delimiting, so a match starting on a component ends on a component
+            const auto pattern = _Right.data();
+            const auto bytes = data();
+            for (auto i = size(); !pattern.empty() && i > 0; i--) {
+                auto first = static_cast<ptrdiff_t>(start(i - 1));
+                if (bytes.size() - first >= pattern.size() && bytes.subspan(first, pattern.size()) == pattern) return prefix(i - 1);
+            }
+            return *this;
         }
 
         //
         inline bool has(addr_t protocol) const 
         {
-            return std::find_if(_protocols.begin(), _protocols.end(), [&](auto a) { return a.addr() == protocol; }) != _protocols.end();
+            return std::any_of(begin(), end(), [&](const addr_view& a) { return a.addr() == protocol; });
         }
 
         // Accessors
-        bool        empty()              const { return _protocols.empty(); }
-        const auto& protocols()          const { return _protocols; }
-        size_t      size()               const { return _protocols.size(); }
-        const auto& operator[](size_t i) const { return _protocols[i]; }
-        
-        string_t str() const 
+        bool             empty()              const { return size() == 0; }
+        size_t           size()               const { return _store.empty() ? 0 : word(0); }
+        const multiaddr& protocols()          const { return *this; }
+        const_iterator   begin()              const { return { this, 0 }; }
+        const_iterator   end()                const { return { this, size() }; }
+
+        // Protocol of the component i, without reading its value
+        addr_t protocol(size_t i) const
         {
-            if (empty()) return "/";
+            uint32_t code;
+            uvarint::decode(data().subspan(start(i)), &code);
+            return details::_AddrTable[details::find_addrimpl_by_code(code)].key;
+        }
 
-            auto oss = std::ostringstream{};
-            for (auto prot : _protocols) {
-                oss << "/" << prot._addr.name() << "/" << prot.str();
-            }
-            return oss.str(); 
+        addr_view operator[](size_t i) const
+        {
+            auto index = 0;
+            auto value = bufferview_t{};
+            details::read_component(data().subspan(start(i), word(i + 1) - start(i)), index, value);
+            return { index, value };
         }
+        
+        // String form
+        //    format() writes to dst, which must hold str_length() characters, and returns that length.
+        size_t   str_length()                 const { return details::format_components(*this, nullptr); }
+        size_t   format(gsl::span<char> dst)  const { Expects(static_cast<size_t>(dst.size()) >= str_length()); return details::format_components(*this, dst.data()); }
+        string_t str()                        const { return details::format_string(*this); }
        
-        buffer_t data() const 
+        bufferview_t data() const 
         {
-            auto buffer = buffer_t{};
-            for (auto prot : _protocols) {
-                uvarint::encode(prot._addr.code(), std::back_inserter(buffer));
-                auto value = prot.data();
-                std::copy(value.begin(), value.end(), std::back_inserter(buffer));
-            }
-            return buffer;
+            if (_store.empty()) return {};
+            auto header = 2 * (size() + 1);
+            return { _store.data() + header, static_cast<ptrdiff_t>(_store.size() - header) };
+        }
+
+        multiaddr_view view() const { return { data(), details::verified }; }
+
+        // View of the first count components, without copy
+        multiaddr_view view(size_t count) const
+        {
+            Expects(count <= size());
+            return { data().first(count ? word(count) : 0), details::verified };
         }
 
 
     private:
-        std::vector<addr_buffer<>> _protocols;
+        // The store holds 16-bit words [count][end of each component], then the binary form
+        using store_t = small_buffer<60>;
+
+        size_t word(size_t i) const
+        {
+            uint16_t w;
+            std::memcpy(&w, _store.data() + 2 * i, sizeof(w));
+            return w;
+        }
+        size_t start(size_t i) const { return i ? word(i) : 0; }
+
+        static void put_word(byte_t* words, size_t i, size_t w)
+        {
+            auto v = static_cast<uint16_t>(w);
+            std::memcpy(words + 2 * i, &v, sizeof(v));
+        }
+
+        // Validate a binary form and index its components
+        void assign(bufferview_t binary)
+        {
+            if (binary.empty()) {
+                _store = store_t{};
+                return;
+            }
+            if (binary.size() > 0xFFFF) throw std::invalid_argument("Invalid multiaddr format: address too long");
+
+            auto count = size_t{ 0 };
+            for (auto view = binary; !view.empty(); count++) {
+                auto index = 0;
+                auto value = bufferview_t{};
+                view = details::read_component(view, index, value);
+            }
+
+            auto store = store_t{};
+            auto words = store.allocate(2 * (count + 1) + binary.size());
+            put_word(words, 0, count);
+            auto i = size_t{ 0 };
+            for (auto view = binary; !view.empty(); ) {
+                auto index = 0;
+                auto value = bufferview_t{};
+                view = details::read_component(view, index, value);
+                put_word(words, ++i, binary.size() - view.size());
+            }
+            std::copy(binary.begin(), binary.end(), words + 2 * (count + 1));
+            _store = std::move(store);
+        }
+
+        // The address made of the first count components
+        multiaddr prefix(size_t count) const
+        {
+            auto result = multiaddr{};
+            if (count == 0) return result;
+
+            auto bytes = data().first(word(count));
+            auto words = result._store.allocate(2 * (count + 1) + bytes.size());
+            std::memcpy(words, _store.data(), 2 * (count + 1));
+            put_word(words, 0, count);
+            std::copy(bytes.begin(), bytes.end(), words + 2 * (count + 1));
+            return result;
+        }
+
+        store_t _store;
     };
 
 
     // Comparison operators
     inline bool operator==(const multiaddr& a, const multiaddr& b) 
     {
-        return (a.protocols() == b.protocols());
+        return (a.data() == b.data());
     }
     
     inline bool operator!=(const multiaddr& a, const multiaddr& b) 
@@ -478,15 +963,7 @@ namespace details {
     
     inline bool operator<(const multiaddr& a, const multiaddr& b) 
     {
-        auto ap = a.protocols();
-        auto bp = b.protocols();
-
-        auto minsize = std::min(ap.size(), bp.size());
-        for (auto i = 0; i < minsize; i++) {
-            if (ap[i] < bp[i]) return true;
-            if (bp[i] < ap[i]) return false;
-        }
-        return false;
+        return details::compare_binary(a.data(), b.data()) < 0;
     }
 
 
@@ -498,167 +975,160 @@ namespace details {
 
     namespace details {
 
-        using addr_span = gsl::span<const addr_buffer<>>;
+        // Deterministic automaton over the protocols of the components of a multiaddr
+        //    State 0 rejects everything and state 1 is the start; bit k of accept[s] is set if pattern k matches
+        //    the components read up to state s.
+        struct addr_dfa
+        {
+            static constexpr size_t symbols = _countof(_AddrTable);
 
-        template <addr_t _Addr>
-        class vbase {
-        public:
-            static addr_span partialmatch(addr_span s)
-            {
-                if (s.empty()) return {};
-                if (s[0].addr() != _Addr) return {};
-                return s.last(s.size() - 1);
-            }
-        };
+            std::vector<uint16_t> next;     // next[state * symbols + protocol]
+            std::vector<uint32_t> accept;
 
-        template <class FirstType, class ... Types>
-        class vand {
-        public:
-            static addr_span partialmatch(addr_span s)
+            template <class _Range>
+            uint32_t run(const _Range& components) const
             {
-                auto a = FirstType::partialmatch(s);
-                if (a.data() == nullptr || sizeof...(Types)==0) return a;
-                return vand<Types...>::partialmatch(a);
+                auto state = size_t{ 1 };
+                for (auto a : components) {
+                    state = next[state * symbols + a.addr()];
+                    if (state == 0) return 0;
+                }
+                return accept[state];
             }
-        };
-        template <class FirstType>
-        class vand<FirstType> {
-        public:
-            static addr_span partialmatch(addr_span s)
+
+            // the offsets of the components of a multiaddr let it skip their values
+            uint32_t run(const multiaddr& ma) const
             {
-                return FirstType::partialmatch(s);
+                auto state = size_t{ 1 };
+                for (size_t i = 0, n = ma.size(); i < n; i++) {
+                    state = next[state * symbols + ma.protocol(i)];
+                    if (state == 0) return 0;
+                }
+                return accept[state];
             }
+
+            size_t states() const { return accept.size(); }
         };
 
+        // Compile up to 32 patterns into one automaton, where pattern k sets bit k of accept
+        addr_dfa compile_patterns(gsl::span<const stringview_t> patterns);
+    }
 
-        template <class FirstType, class ...Types>
-        struct vor {
-            static addr_span partialmatch(addr_span s)
-            {
-                auto a = FirstType::partialmatch(s);
-                if (a.data() || sizeof...(Types)==0) return a;
-                return vor<Types...>::partialmatch(s);
-            }
-        };
-        template <class FirstType>
-        struct vor<FirstType> {
-            static addr_span partialmatch(addr_span s)
-            {
-                return FirstType::partialmatch(s);
-            }
-        };
+    //
+    // A pattern over the protocols of a multiaddr
+    //    The grammar is made of protocol names, groups in (), alternatives separated by | and the repetitions
+    //    ?, * and +. Names are separated by slashes or spaces: "(ip4|ip6)/tcp/(ws|wss)", "p2p-circuit (ipfs)?".
+    //    The pattern is compiled once into a table-driven automaton, so a match is a single pass over the components.
+    //
+    class multiaddr_pattern
+    {
+    public:
+        // Construct by compiling _Right, which throws std::invalid_argument if it is not a valid pattern
+        explicit multiaddr_pattern(stringview_t _Right) : _dfa(details::compile_patterns({ &_Right, 1 }))
+        { }
+        explicit multiaddr_pattern(const char* _Right) : multiaddr_pattern(gsl::ensure_z(_Right))
+        { }
+
+        bool match(const multiaddr& ma) const       { return _dfa.run(ma) != 0; }
+        bool match(const multiaddr_view& ma) const  { return _dfa.run(ma) != 0; }
 
+        size_t states() const { return _dfa.states(); }
 
-        template <class Type>
-        bool match(const multiaddr& ma)
+    private:
+        details::addr_dfa _dfa;
+    };
+
+    namespace details {
+
+        // The patterns of js-mafmt
+        struct addr_patterns
         {
-            auto out = Type::partialmatch(gsl::make_span(ma.protocols()));
-            return out.data() && out.size() == 0;
-        }
+            multiaddr_pattern dns4, dns6, dns, ip, tcp, udp, utp, http, websockets, websocketssecure,
+                websocketsstar, webrtcstar, webrtcdirect, reliable, circuit, ipfs;
 
-        //
-        using DNS4 = vbase<dns4>;
-        using DNS6 = vbase<dns6>;
-        using _DNS = vor<vbase<dns>, DNS4, DNS6>;
-
-        using IP = vor <vbase<ip4>, vbase<ip6>>;
-        using TCP = vand <IP, vbase<tcp>>;
-        using UDP = vand <IP, vbase<udp>>;
-        using UTP = vand <UDP, vbase<utp>>;
-
-        using DNS = vor <
-            vand <_DNS, vbase<tcp>>,
-            _DNS
-        >;
-
-        using WebSockets = vor <
-            vand <TCP, vbase<ws>>,
-            vand <DNS, vbase<ws>>
-        >;
-
-        using WebSocketsSecure = vor <
-            vand <TCP, vbase<wss>>,
-            vand <DNS, vbase<wss>>
-        >;
-
-        using HTTP = vor <
-            vand <TCP, vbase<http>>,
-            vand <DNS>,
-            vand <DNS, vbase<http>>
-        >;
-
-        using WebRTCStar = vor <
-            vand <WebSockets, vbase<p2p_webrtc_star>, vbase<ipfs>>,
-            vand <WebSocketsSecure, vbase<p2p_webrtc_star>, vbase<ipfs>>
-        >;
-
-        using WebSocketStar = vor <
-            vand <WebSockets, vbase<p2p_websocket_star>, vbase<ipfs>>,
-            vand <WebSocketsSecure, vbase<p2p_websocket_star>, vbase<ipfs>>,
-            vand <WebSockets, vbase<p2p_websocket_star>>,
-            vand <WebSocketsSecure, vbase<p2p_websocket_star>>
-        >;
-
-        using WebRTCDirect = vand <HTTP, vbase<p2p_webrtc_direct>>;
-
-        using Reliable = vor <
-            WebSockets,
-            WebSocketsSecure,
-            HTTP,
-            WebRTCStar,
-            WebRTCDirect,
-            TCP,
-            UTP
-        >;
-
-        using _IPFS = vor <
-            vand <Reliable, vbase<ipfs>>,
-            WebRTCStar,
-            vbase<ipfs>
-        >;
-
-        using _Circuit = vor <
-            vand <_IPFS, vbase<p2p_circuit>, _IPFS>,
-            vand <_IPFS, vbase<p2p_circuit>>,
-            vand <vbase<p2p_circuit>, _IPFS>,
-            vand <Reliable, vbase<p2p_circuit>>,
-            vand <vbase<p2p_circuit>, Reliable>,
-            vbase<p2p_circuit>
-        >;
-
-
-        class CircuitRecursive : public vor <
-            vand <_Circuit, CircuitRecursive>,
-            _Circuit
-        >{};
-
-        using Circuit = CircuitRecursive;
-
-        using IPFS = vor <
-            vand <Circuit, _IPFS, Circuit>,
-            vand <_IPFS, Circuit>,
-            vand <Circuit, _IPFS>,
-            Circuit,
-            _IPFS
-        >;
+            // all of them in one automaton, with the bits of addr_class
+            addr_dfa classes;
+        };
+        const addr_patterns& builtin_patterns();
     }
 
-    inline bool is_dns4(const multiaddr& ma)            { return details::match<details::DNS4>(ma); }
-    inline bool is_dns6(const multiaddr& ma)            { return details::match<details::DNS6>(ma); }
-    inline bool is_dns(const multiaddr& ma)             { return details::match<details::DNS>(ma); }
-    inline bool is_ip(const multiaddr& ma)              { return details::match<details::IP>(ma); }
-    inline bool is_tcp(const multiaddr& ma)             { return details::match<details::TCP>(ma); }
-    inline bool is_udp(const multiaddr& ma)             { return details::match<details::UDP>(ma); }
-    inline bool is_utp(const multiaddr& ma)             { return details::match<details::UTP>(ma); }
-    inline bool is_http(const multiaddr& ma)            { return details::match<details::HTTP>(ma); }
-    inline bool is_websockets(const multiaddr& ma)      { return details::match<details::WebSockets>(ma); }
-    inline bool is_websocketssecure(const multiaddr& ma){ return details::match<details::WebSocketsSecure>(ma); }
-    inline bool is_websocketsstar(const multiaddr& ma)  { return details::match<details::WebSocketStar>(ma); }
-    inline bool is_webrtcstar(const multiaddr& ma)      { return details::match<details::WebRTCStar>(ma); }
-    inline bool is_webrtcdirect(const multiaddr& ma)    { return details::match<details::WebRTCDirect>(ma); }
-    inline bool is_reliable(const multiaddr& ma)        { return details::match<details::Reliable>(ma); }
-    inline bool is_circuit(const multiaddr& ma)         { return details::match<details::Circuit>(ma); }
-    inline bool is_ipfs(const multiaddr& ma)            { return details::match<details::IPFS>(ma); }
+    inline bool is_dns4(const multiaddr& ma)            { return details::builtin_patterns().dns4.match(ma); }
+    inline bool is_dns6(const multiaddr& ma)            { return details::builtin_patterns().dns6.match(ma); }
+    inline bool is_dns(const multiaddr& ma)             { return details::builtin_patterns().dns.match(ma); }
+    inline bool is_ip(const multiaddr& ma)              { return details::builtin_patterns().ip.match(ma); }
+    inline bool is_tcp(const multiaddr& ma)             { return details::builtin_patterns().tcp.match(ma); }
+    inline bool is_udp(const multiaddr& ma)             { return details::builtin_patterns().udp.match(ma); }
+    inline bool is_utp(const multiaddr& ma)             { return details::builtin_patterns().utp.match(ma); }
+    inline bool is_http(const multiaddr& ma)            { return details::builtin_patterns().http.match(ma); }
+    inline bool is_websockets(const multiaddr& ma)      { return details::builtin_patterns().websockets.match(ma); }
+    inline bool is_websocketssecure(const multiaddr& ma){ return details::builtin_patterns().websocketssecure.match(ma); }
+    inline bool is_websocketsstar(const multiaddr& ma)  { return details::builtin_patterns().websocketsstar.match(ma); }
+    inline bool is_webrtcstar(const multiaddr& ma)      { return details::builtin_patterns().webrtcstar.match(ma); }
+    inline bool is_webrtcdirect(const multiaddr& ma)    { return details::builtin_patterns().webrtcdirect.match(ma); }
+    inline bool is_reliable(const multiaddr& ma)        { return details::builtin_patterns().reliable.match(ma); }
+    inline bool is_circuit(const multiaddr& ma)         { return details::builtin_patterns().circuit.match(ma); }
+    inline bool is_ipfs(const multiaddr& ma)            { return details::builtin_patterns().ipfs.match(ma); }
+
+
+    //
+    // Classification of multiaddrs by all the patterns above at once
+    //    Bit addr_class::X of the class of an address is set if is_X() holds. The classes are computed in a single pass
+    //    over the components of each address.
+    //
+    namespace addr_class {
+        constexpr uint32_t dns4             = 1u << 0;
+        constexpr uint32_t dns6             = 1u << 1;
+        constexpr uint32_t dns              = 1u << 2;
+        constexpr uint32_t ip               = 1u << 3;
+        constexpr uint32_t tcp              = 1u << 4;
+        constexpr uint32_t udp              = 1u << 5;
+        constexpr uint32_t utp              = 1u << 6;
+        constexpr uint32_t http             = 1u << 7;
+        constexpr uint32_t websockets       = 1u << 8;
+        constexpr uint32_t websocketssecure = 1u << 9;
+        constexpr uint32_t websocketsstar   = 1u << 10;
+        constexpr uint32_t webrtcstar       = 1u << 11;
+        constexpr uint32_t webrtcdirect     = 1u << 12;
+        constexpr uint32_t reliable         = 1u << 13;
+        constexpr uint32_t circuit          = 1u << 14;
+        constexpr uint32_t ipfs             = 1u << 15;
+    }
 
+    inline uint32_t classify(const multiaddr& ma)       { return details::builtin_patterns().classes.run(ma); }
+    inline uint32_t classify(const multiaddr_view& ma)  { return details::builtin_patterns().classes.run(ma); }
 
+    // Batch classification: classes[i] is set to classify(addrs[i])
+    //    The classes are a separate array, so that ranking or filtering a batch reads 4 bytes per address.
+    template <class _Addr>
+    void classify(gsl::span<const _Addr> addrs, gsl::span<uint32_t> classes)
+    {
+        Expects(classes.size() >= addrs.size());
+        const auto& dfa = details::builtin_patterns().classes;
+        auto out = classes.data();
+        for (const auto& ma : addrs) *out++ = dfa.run(ma);
+    }
+    template <class _Addr>
+    void classify(const std::vector<_Addr>& addrs, gsl::span<uint32_t> classes)
+    {
+        classify(gsl::span<const _Addr>{ addrs }, classes);
+    }
+
+
+}
+
+
+namespace std {
+
+    // Hash support for unordered containers, over the binary form
+    template <>
+    struct hash<multiformats::multiaddr_view>
+    {
+        size_t operator()(const multiformats::multiaddr_view& ma) const { return static_cast<size_t>(multiformats::details::hash_binary(ma.data())); }
+    };
+
+    template <>
+    struct hash<multiformats::multiaddr>
+    {
+        size_t operator()(const multiformats::multiaddr& ma) const { return static_cast<size_t>(multiformats::details::hash_binary(ma.data())); }
+    };
 }
@@ -0,0 +1,280 @@
+#pragma once
+
+#include "multiaddr.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace multiformats {
+
+    //
+    // An intern table of multiaddrs
+    //    Each distinct binary form is stored once and named by a 32-bit handle, so that interned addresses cost
+    //    4 bytes where they are referenced and compare equal when their handles are equal.
+    //    intern() and find() may be called concurrently: the table is split in shards that each have a lock and
+    //    an arena for the bytes. get() does not lock, and the bytes of a handle never move.
+    //    - permanent: the pool only grows and a handle is valid as long as the pool
+    //    - arena: clear() releases every address at once; the handles carry the generation of the pool, so that
+    //      a handle of a previous generation is rejected. A handle has room for 256 generations: clear() throws
+    //      rather than reuse one, and a new pool is needed once they are exhausted
+    //
+    class multiaddr_pool
+    {
+    public:
+        using handle_t = uint32_t;
+        static constexpr handle_t null_handle = 0;
+
+        enum class mode { permanent, arena };
+
+        explicit multiaddr_pool(mode m = mode::permanent)
+            : _mode(m), _index_bits(m == mode::arena ? 24 : 32)
+        { }
+
+        ~multiaddr_pool() { release(); }
+
+        multiaddr_pool(const multiaddr_pool&) = delete;
+        multiaddr_pool& operator=(const multiaddr_pool&) = delete;
+
+        // Return the handle of an address, adding it if it is new
+        handle_t intern(const multiaddr_view& ma) { return insert(ma.data()); }
+        handle_t intern(const multiaddr& ma) { return intern(ma.view()); }
+        handle_t intern(bufferview_t binary) { return intern(multiaddr_view{ binary }); }
+
+        // Return the handle of an address, or null_handle if it is not in the pool
+        handle_t find(const multiaddr_view& ma) const { return lookup(ma.data()); }
+        handle_t find(const multiaddr& ma) const { return find(ma.view()); }
+
+        // The address of a handle, valid until the pool is cleared or destroyed
+        multiaddr_view get(handle_t handle) const
+        {
+            auto& e = entry_of(handle);
+            return { { e.data, static_cast<ptrdiff_t>(e.size) }, details::verified };
+        }
+        multiaddr_view operator[](handle_t handle) const { return get(handle); }
+
+        mode   pool_mode() const { return _mode; }
+        size_t size()      const { return _count.load(std::memory_order_acquire); }
+        bool   empty()     const { return size() == 0; }
+
+        // Heap bytes used by the pool
+        size_t memory_usage() const
+        {
+            auto bytes = size_t{ 0 };
+            for (size_t s = 0; s < max_segments; s++)
+                if (_segments[s].load(std::memory_order_acquire)) bytes += segment_size(s) * sizeof(entry);
+            for (auto& sh : _shards) {
+                auto lock = std::unique_lock<std::mutex>{ sh.mutex };
+                bytes += sh.slots.capacity() * sizeof(handle_t) + sh.blocks.capacity() * sizeof(sh.blocks[0]);
+                for (auto& b : sh.blocks) bytes += b.size;
+            }
+            return bytes;
+        }
+
+        // Release every address (arena mode only)
+        //    Must not run concurrently with another call; the handles and views of the pool become invalid.
+        //    Throws std::length_error, and keeps the addresses, when the generations are exhausted.
+        void clear()
+        {
+            Expects(_mode == mode::arena);
+            if (_generation == max_generation) throw std::length_error("multiaddr_pool generations are exhausted");
+            release();
+            _generation++;
+        }
+
+    private:
+        static constexpr size_t shard_bits = 4;
+        static constexpr size_t first_segment_bits = 10;
+        static constexpr size_t max_segments = 32 - first_segment_bits + 1;
+        static constexpr size_t block_size = 16 * 1024;
+        static constexpr uint32_t max_generation = 0xFF;
+
+        struct entry
+        {
+            const byte_t* data;
+            uint32_t size;
+            uint32_t hash;
+        };
+
+        struct block
+        {
+            std::unique_ptr<byte_t[]> bytes;
+            size_t size;
+        };
+
+        // A shard indexes the addresses whose hash falls in it, in an open addressing table of handles
+        struct shard
+        {
+            std::mutex mutex;
+            std::vector<handle_t> slots;
+            size_t count = 0;
+            std::vector<block> blocks;
+            byte_t* cursor = nullptr;   // free bytes of the current block
+            size_t room = 0;
+        };
+
+        // The entries are stored in segments of doubling size, which never move once allocated:
+        // segment s holds the indexes [2^(s+10) - 2^10, 2^(s+11) - 2^10)
+        static size_t segment_of(size_t index, size_t& offset)
+        {
+            auto biased = index + (size_t{ 1 } << first_segment_bits);
+            auto s = size_t{ 0 };
+            while ((biased >> (s + first_segment_bits + 1)) != 0) s++;
+            offset = biased - (size_t{ 1 } << (s + first_segment_bits));
+            return s;
+        }
+        static size_t segment_size(size_t s) { return size_t{ 1 } << (s + first_segment_bits); }
+
+        handle_t make_handle(size_t index) const
+        {
+            auto h = static_cast<handle_t>(index + 1);
+            return _mode == mode::arena ? h | static_cast<handle_t>(_generation << 24) : h;
+        }
+
+        size_t index_of(handle_t handle) const
+        {
+            auto h = _index_bits < 32 ? handle & ((handle_t{ 1 } << _index_bits) - 1) : handle;
+            Expects(h != 0 && h <= size());
+            if (_mode == mode::arena) Expects((handle >> 24) == _generation);
+            return h - 1;
+        }
+
+        const entry& entry_of(handle_t handle) const
+        {
+            auto offset = size_t{ 0 };
+            auto s = segment_of(index_of(handle), offset);
+            return _segments[s].load(std::memory_order_acquire)[offset];
+        }
+
+        entry& new_entry(size_t index)
+        {
+            auto offset = size_t{ 0 };
+            auto s = segment_of(index, offset);
+            auto segment = _segments[s].load(std::memory_order_acquire);
+            if (!segment) {
+                auto lock = std::unique_lock<std::mutex>{ _grow };
+                segment = _segments[s].load(std::memory_order_relaxed);
+                if (!segment) {
+                    segment = new entry[segment_size(s)];
+                    _segments[s].store(segment, std::memory_order_release);
+                }
+            }
+            return segment[offset];
+        }
+
+        // Copy bytes in the arena of a shard; an address larger than a quarter of a block gets a block of its own
+        static const byte_t* store(shard& sh, bufferview_t binary)
+        {
+            const auto n = static_cast<size_t>(binary.size());
+            if (n == 0) return nullptr;
+
+            byte_t* dst;
+            if (n > block_size / 4) {
+                sh.blocks.push_back({ std::unique_ptr<byte_t[]>{ new byte_t[n] }, n });
+                dst = sh.blocks.back().bytes.get();
+            }
+            else {
+                if (n > sh.room) {
+                    sh.blocks.push_back({ std::unique_ptr<byte_t[]>{ new byte_t[block_size] }, block_size });
+                    sh.cursor = sh.blocks.back().bytes.get();
+                    sh.room = block_size;
+                }
+                dst = sh.cursor;
+                sh.cursor += n;
+                sh.room -= n;
+            }
+            std::copy(binary.begin(), binary.end(), dst);
+            return dst;
+        }
+
+        shard& shard_of(uint64_t hash) const { return _shards[hash >> (64 - shard_bits)]; }
+
+        // Search the table of a shard, which must be locked
+        handle_t probe(const shard& sh, bufferview_t binary, uint32_t key) const
+        {
+            if (sh.slots.empty()) return null_handle;
+
+            const auto mask = sh.slots.size() - 1;
+            for (auto i = key & mask; sh.slots[i] != null_handle; i = (i + 1) & mask) {
+                auto& e = entry_of(sh.slots[i]);
+                if (e.hash == key && e.size == static_cast<size_t>(binary.size()) && std::equal(binary.begin(), binary.end(), e.data))
+                    return sh.slots[i];
+            }
+            return null_handle;
+        }
+
+        handle_t lookup(bufferview_t binary) const
+        {
+            const auto hash = details::hash_binary(binary);
+            auto& sh = shard_of(hash);
+            auto lock = std::unique_lock<std::mutex>{ sh.mutex };
+            return probe(sh, binary, static_cast<uint32_t>(hash));
+        }
+
+        handle_t insert(bufferview_t binary)
+        {
+            const auto hash = details::hash_binary(binary);
+            const auto key = static_cast<uint32_t>(hash);
+            auto& sh = shard_of(hash);
+
+            auto lock = std::unique_lock<std::mutex>{ sh.mutex };
+            auto found = probe(sh, binary, key);
+            if (found != null_handle) return found;
+
+            // reserve an index; the entry is written before the handle is published
+            const auto index = _count.fetch_add(1, std::memory_order_acq_rel);
+            const auto limit = _index_bits < 32 ? (size_t{ 1 } << _index_bits) - 1 : size_t{ 0xFFFFFFFE };
+            if (index >= limit) {
+                _count.fetch_sub(1, std::memory_order_acq_rel);
+                throw std::length_error("multiaddr_pool is full");
+            }
+            new_entry(index) = { store(sh, binary), static_cast<uint32_t>(binary.size()), key };
+            const auto handle = make_handle(index);
+
+            // keep the table at most 3/4 full
+            if (4 * (sh.count + 1) > 3 * sh.slots.size()) grow(sh);
+            const auto mask = sh.slots.size() - 1;
+            auto i = key & mask;
+            while (sh.slots[i] != null_handle) i = (i + 1) & mask;
+            sh.slots[i] = handle;
+            sh.count++;
+            return handle;
+        }
+
+        void grow(shard& sh)
+        {
+            auto slots = std::vector<handle_t>(sh.slots.empty() ? 64 : 2 * sh.slots.size(), null_handle);
+            const auto mask = slots.size() - 1;
+            for (auto h : sh.slots) {
+                if (h == null_handle) continue;
+                auto i = entry_of(h).hash & mask;
+                while (slots[i] != null_handle) i = (i + 1) & mask;
+                slots[i] = h;
+            }
+            sh.slots = std::move(slots);
+        }
+
+        void release()
+        {
+            for (auto& sh : _shards) {
+                sh.slots = std::vector<handle_t>{};
+                sh.count = 0;
+                sh.blocks = std::vector<block>{};
+                sh.cursor = nullptr;
+                sh.room = 0;
+            }
+            for (auto& s : _segments) delete[] s.exchange(nullptr);
+            _count = 0;
+        }
+
+        const mode _mode;
+        const size_t _index_bits;
+        uint32_t _generation = 0;
+
+        mutable shard _shards[size_t{ 1 } << shard_bits];
+        std::atomic<entry*> _segments[max_segments] = {};
+        std::atomic<size_t> _count{ 0 };
+        std::mutex _grow;
+    };
+}
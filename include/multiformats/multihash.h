@@ -2,32 +2,80 @@
 
 #include "common.h"
 #include "multibase.h"
+#include "thread_pool.h"
 #include "uvarint.h"
 #include <gsl/gsl>
+#include <atomic>
+#include <deque>
 #include <map>
+#include <functional>
+#include <mutex>
+#include <string>
+
+#ifdef MULTIFORMATS_WITH_OPENSSL
+#include <openssl/evp.h>
+#endif
 
 
 namespace multiformats {
 
-    enum hash_t {
+    //
+    // Storage of digests and multihashes
+    //   Keeps a 512-bit digest together with its varint code and size inline, without heap allocation.
+    //
+    using hashbuffer_t = small_buffer<68>;
+
+
+    enum hash_t : int {
         dynamic_hash = -1,
         sha1,
-        sha2_256
+        sha2_256,
+
+        // Keys of the hash functions registered at runtime (see register_hash)
+        first_registered_hash = 0x1000
     };
 
+    // Largest digest produced by the implemented hash functions
+    constexpr size_t max_digest_size = 64;
+
     namespace details {
 
+        // Opaque state of an incremental digest computation
+        struct hash_context {
+            uint64_t state[32];
+        };
+
+        typedef void(*HashInit)(hash_context&);
+        typedef void(*HashUpdate)(hash_context&, bufferview_t);
+        typedef void(*HashFinal)(hash_context&, byte_t*);
+        typedef void(*HashRelease)(hash_context&);
+
+        inline void hash_init_noimpl(hash_context& /*ctx*/) { throw std::logic_error("Function not yet implemented"); }
+        inline void hash_update_noimpl(hash_context& /*ctx*/, bufferview_t /*data*/) { throw std::logic_error("Function not yet implemented"); }
+        inline void hash_final_noimpl(hash_context& /*ctx*/, byte_t* /*digest*/) { throw std::logic_error("Function not yet implemented"); }
+
+        void sha1_init(hash_context& ctx);
+        void sha1_update(hash_context& ctx, bufferview_t data);
+        void sha1_final(hash_context& ctx, byte_t* digest);
+
+        void sha2_256_init(hash_context& ctx);
+        void sha2_256_update(hash_context& ctx, bufferview_t data);
+        void sha2_256_final(hash_context& ctx, byte_t* digest);
+
         struct hashimpl {
             hash_t      key;
             const char* name;
             uint32_t    code;
             int32_t     len;
+            HashInit    init;
+            HashUpdate  update;
+            HashFinal   final;
         };
 
         constexpr hashimpl _HashTable[] = {
-            { dynamic_hash, "dynamic_hash", 0x00,  0 },
-            { sha1,         "sha1",         0x11, 20 },
-            { sha2_256,     "sha2_256",     0x12, 32 },
+            { dynamic_hash, "dynamic_hash", 0x00,  0, hash_init_noimpl, hash_update_noimpl, hash_final_noimpl },
+            { sha1,         "sha1",         0x11, 20, sha1_init       , sha1_update       , sha1_final        },
+            { sha2_256,     "sha2_256",     0x12, 32, sha2_256_init   , sha2_256_update   , sha2_256_final    },
         };
 
         constexpr int find_hashimpl_by_key(hash_t code) {
@@ -42,6 +90,121 @@ namespace multiformats {
             return 0;
         }
 
+        // Implementation of a hash function: in-tree, or an adapter to an external library
+        //    The context is zeroed before the first init; release, when set, frees what init allocated.
+        struct hash_backend {
+            const char* name;
+            HashInit    init;
+            HashUpdate  update;
+            HashFinal   final;
+            HashRelease release;
+        };
+
+        // Runtime registry of hash functions
+        //    The built-in functions keep their index in _HashTable and the registered ones follow.
+        //    Codes below 2^16 are looked up in a direct index table, larger codes are scanned.
+        class hash_registry
+        {
+        public:
+            static constexpr int      max_entries = 256;
+            static constexpr uint32_t direct_codes = 0x10000;
+
+            static hash_registry& instance() { static hash_registry registry; return registry; }
+
+            const hashimpl& operator[](int index) const { return _entries[index]; }
+            int size() const { return _size.load(std::memory_order_acquire); }
+
+            // Index of a hash function, or 0 if it is unknown
+            int find_by_code(uint32_t code) const
+            {
+                if (code < direct_codes) return _by_code[code].load(std::memory_order_acquire);
+                for (auto i = 1, n = size(); i < n; i++)
+                    if (_entries[i].code == code) return i;
+                return 0;
+            }
+            int find_by_key(hash_t key) const
+            {
+                if (key < first_registered_hash) return find_hashimpl_by_key(key);
+                auto index = static_cast<int>(key - first_registered_hash + _countof(_HashTable));
+                return index < size() ? index : 0;
+            }
+            int find_by_name(const std::string& name) const
+            {
+                for (auto i = 1, n = size(); i < n; i++)
+                    if (name == _entries[i].name) return i;
+                return 0;
+            }
+
+            hash_t add(const std::string& name, uint32_t code, int32_t len, HashInit init, HashUpdate update, HashFinal final)
+            {
+                auto lock = std::lock_guard<std::mutex>{ _mutex };
+                if (len <= 0 || len > static_cast<int32_t>(max_digest_size)) throw std::invalid_argument("Failed to register hash function: wrong size");
+                if (code == 0 || find_by_code(code) != 0 || find_by_name(name) != 0) throw std::invalid_argument("Failed to register hash function: already registered");
+                if (!init || !update || !final) throw std::invalid_argument("Failed to register hash function: missing function");
+
+                auto index = _size.load(std::memory_order_relaxed);
+                if (index == max_entries) throw std::length_error("Failed to register hash function: too many hash functions");
+
+                _names.push_back(name);
+                auto key = static_cast<hash_t>(first_registered_hash + index - _countof(_HashTable));
+                _entries[index] = { key, _names.back().c_str(), code, len, init, update, final };
+                _selected[index].store(publish({ "builtin", init, update, final, nullptr }), std::memory_order_release);
+                if (code < direct_codes) _by_code[code].store(static_cast<uint8_t>(index), std::memory_order_release);
+                _size.store(index + 1, std::memory_order_release);
+                return key;
+            }
+
+            // The implementation registered with the hash function
+            hash_backend builtin(int index) const { return { "builtin", _entries[index].init, _entries[index].update, _entries[index].final, nullptr }; }
+
+            // The selected implementation, which may be replaced concurrently
+            //    A selection is immutable once published and lives as long as the registry, with a copy of its name.
+            hash_backend backend(int index) const { return _selected[index].load(std::memory_order_acquire)->backend; }
+            const char* backend_name(int index) const { return backend(index).name; }
+
+            void set_backend(int index, const hash_backend& backend)
+            {
+                if (!backend.init || !backend.update || !backend.final) throw std::invalid_argument("Failed to set hash backend: missing function");
+                auto lock = std::lock_guard<std::mutex>{ _mutex };
+                _selected[index].store(publish(backend), std::memory_order_release);
+            }
+
+        private:
+            struct selection {
+                std::string name;
+                hash_backend backend;
+            };
+
+            hash_registry() : _selected{}, _by_code{}
+            {
+                for (auto i = 0; i < _countof(_HashTable); i++) {
+                    _entries[i] = _HashTable[i];
+                    _selected[i] = publish({ "builtin", _HashTable[i].init, _HashTable[i].update, _HashTable[i].final, nullptr });
+                    if (i > 0 && _HashTable[i].code < direct_codes) _by_code[_HashTable[i].code] = static_cast<uint8_t>(i);
+                }
+                _size = _countof(_HashTable);
+            }
+
+            // Store a selection, which is never released since a hasher may still read it (_mutex is held)
+            const selection* publish(const hash_backend& backend)
+            {
+                _selections.push_back({ backend.name ? backend.name : "", backend });
+                auto& s = _selections.back();
+                s.backend.name = s.name.c_str();
+                return &s;
+            }
+
+            hashimpl _entries[max_entries];
+            std::atomic<const selection*> _selected[max_entries];
+            std::deque<selection> _selections;
+            std::atomic<uint8_t> _by_code[direct_codes];
+            std::atomic<int> _size;
+            std::deque<std::string> _names;
+            std::mutex _mutex;
+        };
+
+        inline const hashimpl& hash_entry(int index) { return hash_registry::instance()[index]; }
+
         template <hash_t _Hash = dynamic_hash, int _Index = find_hashimpl_by_key(_Hash)>
         class hashcode_type
         {
@@ -63,12 +226,12 @@ namespace multiformats {
         class hashcode_type<dynamic_hash>
         {
         public:
-            explicit constexpr hashcode_type(hash_t hash) : _index(find_hashimpl_by_key(hash)) { Expects(_index > 0); }
+            explicit hashcode_type(hash_t hash) : _index(hash_registry::instance().find_by_key(hash)) { Expects(_index > 0); }
 
-            const hash_t      hash()  const { return _HashTable[_index].key; }
-            const char*       name()  const { return _HashTable[_index].name; }
-            const uint32_t    code()  const { return _HashTable[_index].code; }
-            const int32_t     len()   const { return _HashTable[_index].len; }
+            const hash_t      hash()  const { return hash_entry(_index).key; }
+            const char*       name()  const { return hash_entry(_index).name; }
+            const uint32_t    code()  const { return hash_entry(_index).code; }
+            const int32_t     len()   const { return hash_entry(_index).len; }
             const int         index() const { return _index; }
         private:
             const int _index;
@@ -77,6 +240,110 @@ namespace multiformats {
     }
 
 
+    // Register an application-specific hash function and return its key
+    //    The hash functions share details::hash_context as state and produce at most max_digest_size bytes.
+    //    Registration is expected at startup; lookups are lock-free and may run concurrently.
+    inline hash_t register_hash(const std::string& name, uint32_t code, int32_t len, details::HashInit init, details::HashUpdate update, details::HashFinal final)
+    {
+        return details::hash_registry::instance().add(name, code, len, init, update, final);
+    }
+
+    // Key of a built-in or registered hash function, or dynamic_hash if it is unknown
+    inline hash_t find_hash(uint32_t code)
+    {
+        auto index = details::hash_registry::instance().find_by_code(code);
+        return index ? details::hash_entry(index).key : dynamic_hash;
+    }
+    inline hash_t find_hash(const std::string& name)
+    {
+        auto index = details::hash_registry::instance().find_by_name(name);
+        return index ? details::hash_entry(index).key : dynamic_hash;
+    }
+
+
+    //
+    // Hash backends
+    //    Each hash function is computed by the in-tree implementation ("builtin") unless another backend is
+    //    selected at startup, e.g. an optimized system library. The hashers constructed afterwards use it.
+    //
+    using details::hash_backend;
+
+    inline void set_hash_backend(hash_t hash, const hash_backend& backend)
+    {
+        details::hash_registry::instance().set_backend(details::hashcode_type<>{ hash }.index(), backend);
+    }
+    inline hash_backend builtin_hash_backend(hash_t hash)
+    {
+        return details::hash_registry::instance().builtin(details::hashcode_type<>{ hash }.index());
+    }
+    inline const char* hash_backend_name(hash_t hash)
+    {
+        return details::hash_registry::instance().backend_name(details::hashcode_type<>{ hash }.index());
+    }
+
+    // Adapter to a library with the libcrypto low-level interface: int Init(Ctx*), int Update(Ctx*, const void*, size_t)
+    // and int Final(unsigned char*, Ctx*), e.g. SHA256_Init/SHA256_Update/SHA256_Final, which return 1 on success.
+    //    The library context is stored in details::hash_context, without allocation.
+    template <typename Ctx, int(*Init)(Ctx*), int(*Update)(Ctx*, const void*, size_t), int(*Final)(unsigned char*, Ctx*)>
+    struct libcrypto_adapter
+    {
+        static_assert(sizeof(Ctx) <= sizeof(details::hash_context), "The library context does not fit in hash_context");
+
+        static void init(details::hash_context& ctx)
+        {
+            if (Init(reinterpret_cast<Ctx*>(&ctx)) != 1) throw std::runtime_error("Failed to initialize digest");
+        }
+        static void update(details::hash_context& ctx, bufferview_t data)
+        {
+            if (Update(reinterpret_cast<Ctx*>(&ctx), data.data(), static_cast<size_t>(data.size())) != 1) throw std::runtime_error("Failed to update digest");
+        }
+        static void final(details::hash_context& ctx, byte_t* digest)
+        {
+            if (Final(digest, reinterpret_cast<Ctx*>(&ctx)) != 1) throw std::runtime_error("Failed to finalize digest");
+        }
+
+        static hash_backend backend(const char* name) { return { name, init, update, final, nullptr }; }
+    };
+
+#ifdef MULTIFORMATS_WITH_OPENSSL
+    // Adapter to the OpenSSL EVP interface, e.g. Md = EVP_sha256
+    //    The EVP_MD_CTX is allocated by the first init and referenced from details::hash_context.
+    template <const EVP_MD*(*Md)()>
+    struct evp_adapter
+    {
+        static EVP_MD_CTX*& context(details::hash_context& ctx) { return *reinterpret_cast<EVP_MD_CTX**>(&ctx); }
+
+        static void init(details::hash_context& ctx)
+        {
+            auto& md = context(ctx);
+            if (!md && !(md = EVP_MD_CTX_new())) throw std::bad_alloc();
+            if (EVP_DigestInit_ex(md, Md(), nullptr) != 1) throw std::runtime_error("Failed to initialize digest");
+        }
+        static void update(details::hash_context& ctx, bufferview_t data)
+        {
+            if (EVP_DigestUpdate(context(ctx), data.data(), static_cast<size_t>(data.size())) != 1) throw std::runtime_error("Failed to update digest");
+        }
+        static void final(details::hash_context& ctx, byte_t* digest)
+        {
+            if (EVP_DigestFinal_ex(context(ctx), digest, nullptr) != 1) throw std::runtime_error("Failed to finalize digest");
+        }
+        static void release(details::hash_context& ctx) { EVP_MD_CTX_free(context(ctx)); }
+
+        static hash_backend backend(const char* name) { return { name, init, update, final, release }; }
+    };
+
+    // Backend of OpenSSL libcrypto, when the library is available at build time
+    inline hash_backend openssl_hash_backend(hash_t hash)
+    {
+        switch (hash) {
+        case sha1:     return evp_adapter<EVP_sha1>::backend("openssl");
+        case sha2_256: return evp_adapter<EVP_sha256>::backend("openssl");
+        default:       throw std::invalid_argument("The hash function is not provided by OpenSSL");
+        }
+    }
+#endif
+
+
     // A strongly typed byte buffer that contains an immutable representation of the output digest for a specific hash algorithm
     // known at compile-time.
     // The specialization with dynamic_hash is used when the hash function is not known at compile-time.
@@ -91,16 +358,16 @@ namespace multiformats {
 
         // Construct by copying _Right
         //    - from bufferview_t
-        digest_buffer(bufferview_t _Right) : _buffer(std::begin(_Right), std::end(_Right)), _hash(_Hash)
+        digest_buffer(bufferview_t _Right) : _buffer(_Right), _hash(_Hash)
         {
             static_assert(_Hash != dynamic_hash, "dynamic_hash is not allowed here");
             Expects(!_Right.empty());
-            Expects(_hash.len() < 0 || _Right.size() == _hash.len());
+            Expects(_hash.len() < 0 || _Right.size() <= _hash.len());
         }
-        digest_buffer(hash_t hash, bufferview_t _Right) : _buffer(std::begin(_Right), std::end(_Right)), _hash(hash)
+        digest_buffer(hash_t hash, bufferview_t _Right) : _buffer(_Right), _hash(hash)
         {
             Expects(!_Right.empty());
-            Expects(_hash.len() < 0 || _Right.size() == _hash.len());
+            Expects(_hash.len() < 0 || _Right.size() <= _hash.len());
         }
 
         //    - from digest_buffer<>
@@ -116,15 +383,16 @@ namespace multiformats {
         }
 
         // Construct by moving _Right
-        digest_buffer(buffer_t&& _Right) : _buffer(std::move(_Right)), _hash(_Hash) 
+        //    - from buffer_t: the bytes are copied in the inline storage
+        digest_buffer(buffer_t&& _Right) : _buffer(_Right), _hash(_Hash) 
         {
             static_assert(_Hash != dynamic_hash, "dynamic_hash is not allowed here");
         }
-        digest_buffer(hash_t hash, buffer_t&& _Right) : _buffer(std::move(_Right)), _hash(hash) {}
+        digest_buffer(hash_t hash, buffer_t&& _Right) : _buffer(_Right), _hash(hash) {}
 
         digest_buffer(digest_buffer<_Hash>&& _Right) : _buffer(std::move(_Right._buffer)), _hash(_Right.hash()) {}
         template <hash_t _RightHash>
-        digest_buffer(digest_buffer<_RightHash>&& _Right) : _string(std::move(_Right._buffer)), _hash(_Right.hash()) {}
+        digest_buffer(digest_buffer<_RightHash>&& _Right) : _buffer(std::move(_Right._buffer)), _hash(_Right.hash()) {}
 
 
         // Assign by copying _Right
@@ -159,7 +427,7 @@ namespace multiformats {
         digest_buffer<_Hash>& operator =(bufferview_t&& _Right)
         {
             Expects(_buffer.empty() && !_Right.empty());
-            _buffer = std::move(_Right);
+            _buffer = _Right;
             return *this;
         }
 
@@ -183,8 +451,8 @@ namespace multiformats {
 
 
         auto hash()  const { return _hash.hash(); }
-        auto data()  const { return _buffer; }
         auto code()  const { return _hash.code(); }
+        bufferview_t data() const { return _buffer; }
 
         auto empty() const { return _buffer.empty(); }
         auto size()  const { return _buffer.size(); }
@@ -193,7 +461,7 @@ namespace multiformats {
 
     private:
         const details::hashcode_type<_Hash> _hash;
-        buffer_t _buffer;
+        hashbuffer_t _buffer;
 
         template <hash_t _FriendHash> friend class digest_buffer;
     };
@@ -225,23 +493,23 @@ namespace multiformats {
         {
             static_assert(_Hash != dynamic_hash, "dynamic_hash is not allowed here");
             Expects(!_Right.empty());
-            Expects(_hash.len() < 0 || decode(this->base(), _Right).size() == _hash.len());
+            Expects(_hash.len() < 0 || decode(this->base(), _Right).size() <= _hash.len());
         }
         digest_string(hash_t hash, stringview_t _Right) : string_t(_Right), _hash(hash)
         {
             Expects(!_Right.empty());
-            Expects(_hash.len() < 0 || decode(this->base(), _Right).size() == _hash.len());
+            Expects(_hash.len() < 0 || decode(this->base(), _Right).size() <= _hash.len());
         }
         digest_string(base_t base, stringview_t _Right) : string_t(base, _Right), _hash(_Hash)
         {
             static_assert(_Hash != dynamic_hash, "dynamic_hash is not allowed here");
             Expects(!_Right.empty());
-            Expects(_hash.len() < 0 || decode(this->base(), _Right).size() == _hash.len());
+            Expects(_hash.len() < 0 || decode(this->base(), _Right).size() <= _hash.len());
         }
         digest_string(hash_t hash, base_t base, stringview_t _Right) : string_t(base, _Right), _hash(hash)
         {
             Expects(!_Right.empty());
-            Expects(_hash.len() < 0 || decode(this->base(), _Right).size() == _hash.len());
+            Expects(_hash.len() < 0 || decode(this->base(), _Right).size() <= _hash.len());
         }
 
         digest_string(const char* _Right) : digest_string(gsl::ensure_z(_Right)) {}
@@ -249,17 +517,23 @@ namespace multiformats {
         digest_string(base_t base, const char* _Right) : digest_string(base, gsl::ensure_z(_Right)) {}
         digest_string(hash_t hash, base_t base, const char* _Right) : digest_string(hash, base, gsl::ensure_z(_Right)) {}
 
+        //    - from an encoded_string<> whose decoded length is already verified: the string is not decoded again
+        digest_string(hash_t hash, encoded_string<_Base>&& _Right, details::verified_t) : string_t(std::move(_Right)), _hash(hash)
+        {
+            Expects(!this->empty());
+        }
+
         //    - from encoded_string<>
         digest_string(const encoded_string<_Base>& _Right) : string_t(_Right), _hash(_Hash)
         {
             static_assert(_Hash != dynamic_hash, "dynamic_hash is not allowed here");
             Expects(!_Right.empty());
-            Expects(_hash.len() < 0 || decode(_Right).size() == _hash.len());
+            Expects(_hash.len() < 0 || decode(_Right).size() <= _hash.len());
         }
         digest_string(hash_t hash, const encoded_string<_Base>& _Right) : string_t(_Right), _hash(hash)
         {
             Expects(!_Right.empty());
-            Expects(_hash.len() < 0 || decode(_Right).size() == _hash.len());
+            Expects(_hash.len() < 0 || decode(_Right).size() <= _hash.len());
         }
 
         template <base_t _RightBase>
@@ -268,14 +542,14 @@ namespace multiformats {
             static_assert(_RightBase == _Base || _RightBase == dynamic_base || _Base == dynamic_base, "Mismatch between codes.");
             static_assert(_Hash != dynamic_hash, "dynamic_hash is not allowed here");
             Expects(!_Right.empty());
-            Expects(_hash.len() < 0 || decode(_Right).size() == _hash.len());
+            Expects(_hash.len() < 0 || decode(_Right).size() <= _hash.len());
         }
         template <base_t _RightBase>
         digest_string(hash_t hash, const encoded_string<_RightBase>& _Right) : string_t(_Right), _hash(hash)
         {
             static_assert(_RightBase == _Base || _RightBase == dynamic_base || _Base == dynamic_base, "Mismatch between codes.");
             Expects(!_Right.empty());
-            Expects(_hash.len() < 0 || decode(_Right).size() == _hash.len());
+            Expects(_hash.len() < 0 || decode(_Right).size() <= _hash.len());
         }
 
         //    - from digest_string<>
@@ -308,7 +582,7 @@ namespace multiformats {
         // Note: an digest_string<> is immutable once initialized
         digest_string<_Hash, _Base>& operator =(stringview_t _Right)
         {
-            Expects(_hash.len() < 0 || decode(this->base(), _Right).size() == _hash.len());
+            Expects(_hash.len() < 0 || decode(this->base(), _Right).size() <= _hash.len());
             *((string_t*)this) = _Right;
             return *this;
         }
@@ -319,7 +593,7 @@ namespace multiformats {
 
         digest_string<_Hash, _Base>& operator =(const encoded_string<_Base>& _Right)
         {
-            Expects(_hash.len() < 0 || decode(_Right).size() == _hash.len());
+            Expects(_hash.len() < 0 || decode(_Right).size() <= _hash.len());
             *((string_t*)this) = _Right;
             return *this;
         }
@@ -327,15 +601,16 @@ namespace multiformats {
         digest_string<_Hash, _Base>& operator =(const encoded_string<_RightBase>& _Right)
         {
             static_assert(_RightBase == _Base || _RightBase == dynamic_base || _Base == dynamic_base, "Mismatch between codes.");
-            Expects(_hash.len() < 0 || decode(_Right).size() == _hash.len());
+            Expects(_hash.len() < 0 || decode(_Right).size() <= _hash.len());
             *((string_t*)this) = _Right;
             return *this;
         }
 
+        //    - from digest_string<>: the length of _Right is already verified
         digest_string<_Hash, _Base>& operator =(const digest_string<_Hash, _Base>& _Right)
         {
             Expects(_Right.hash() == hash());
-            *this = _Right.str();
+            string_t::operator=(static_cast<const string_t&>(_Right));
             return *this;
         }
         template <hash_t _RightHash, base_t _RightBase>
@@ -344,7 +619,7 @@ namespace multiformats {
             static_assert(_RightHash == _Hash || _RightHash == dynamic_hash || _Hash == dynamic_hash, "Mismatch between codes.");
             static_assert(_RightBase == _Base || _RightBase == dynamic_base || _Base == dynamic_base, "Mismatch between codes.");
             Expects(_Right.hash() == hash());
-            *this = _Right.str();
+            string_t::operator=(static_cast<const encoded_string<_RightBase>&>(_Right));
             return *this;
         }
 
@@ -357,39 +632,46 @@ namespace multiformats {
     //
     // Encode a digest into a _Base encoded_string
     //
+    //    The length of a digest_buffer<> is verified at construction, so the encoded string is not decoded again.
     template <hash_t _Hash, base_t _Base>
     digest_string<_Hash, _Base> encode(const digest_buffer<_Hash>& digest)
     {
         Expects(!digest.empty());
-        return encode<_Base>(digest);
+        return { digest.hash(), encode<_Base>(digest.data()), details::verified };
     }
 
     template <hash_t _Hash>
     digest_string<_Hash> encode(base_t base, const digest_buffer<_Hash>& digest)
     {
         Expects(!digest.empty());
-        return encode(base, digest);
+        return { digest.hash(), encode(base, digest.data()), details::verified };
     }
 
     inline digest_string<> encode(hash_t hash, base_t base, bufferview_t digest)
     {
+        auto type = details::hashcode_type<>{ hash };
         Expects(!digest.empty());
-        return { hash, encode(base, digest) };
+        Expects(type.len() < 0 || digest.size() <= type.len());
+        return { hash, encode(base, digest), details::verified };
     }
 
 
+    //
+    // Decode a digest_string into a digest_buffer
+    //
     template <hash_t _Hash, base_t _Base>
-    digest_buffer<_Hash> decode(digest_string<_Hash, _Base> digest)
+    digest_buffer<_Hash> decode(const digest_string<_Hash, _Base>& digest)
     {
-        return decode(static_cast<encoded_string<_Base>>(digest));
+        return { digest.hash(), decode(static_cast<const encoded_string<_Base>&>(digest)) };
     }
 
 
 
-    class multihash
-    {
-    public:
-        multihash(bufferview_t mhview)
+    namespace details {
+
+        // Parse and check the header of a binary multihash
+        //    Returns the index of the hash function in the hash registry and the size of the digest.
+        inline int parse_multihash(bufferview_t mhview, size_t* pSize)
         {
             auto posIt = mhview.begin();
 
@@ -397,18 +679,84 @@ namespace multiformats {
             auto code = uint32_t{};
             posIt = uvarint::decode(posIt, mhview.end(), &code);
 
-            auto index = details::find_hashimpl_by_code(code);
+            auto index = hash_registry::instance().find_by_code(code);
             if (index == 0) throw std::invalid_argument("Failed to parse multihash buffer: wrong hash code");
-            _hash = details::_HashTable[index].key;
 
             // parse and check size
-            posIt = uvarint::decode(posIt, mhview.end(), &_size);
+            auto size = size_t{};
+            posIt = uvarint::decode(posIt, mhview.end(), &size);
 
-            if (static_cast<ptrdiff_t>(_size) != mhview.end() - posIt) throw std::invalid_argument("Failed to parse multihash buffer: wrong size");
-            if (details::_HashTable[index].len > 0 && _size != details::_HashTable[index].len) throw std::invalid_argument("Failed to parse multihash buffer: wrong size");
+            if (static_cast<ptrdiff_t>(size) != mhview.end() - posIt) throw std::invalid_argument("Failed to parse multihash buffer: wrong size");
+            // the digest may be truncated, but not extended
+            if (size == 0) throw std::invalid_argument("Failed to parse multihash buffer: wrong size");
+            if (size > static_cast<size_t>(hash_entry(index).len)) throw std::invalid_argument("Failed to parse multihash buffer: wrong size");
 
-            // Seems legit
-            _data.assign(mhview.begin(), mhview.end());
+            *pSize = size;
+            return index;
+        }
+    }
+
+
+    // A non-owning view of a binary multihash.
+    // The buffer is validated once at construction and must outlive the view.
+    class multihash_view
+    {
+    public:
+        multihash_view(bufferview_t mhview) : _data(mhview)
+        {
+            _hash = details::hash_entry(details::parse_multihash(mhview, &_size)).key;
+        }
+
+        hash_t       hash()   const { return _hash; }
+        size_t       size()   const { return _size; }
+        bufferview_t digest() const { return _data.last(_size); }
+
+        bufferview_t data()   const { return _data; }
+
+    private:
+        // Construct from already validated fields
+        multihash_view(hash_t hash, size_t size, bufferview_t data) : _hash(hash), _size(size), _data(data)
+        { }
+
+        hash_t _hash;
+        size_t _size;
+        bufferview_t _data;
+
+        friend class multihash;
+        friend class static_multihash;
+    };
+
+
+    class multihash
+    {
+    public:
+        // Construct by copying mhview
+        multihash(bufferview_t mhview) : multihash(multihash_view{ mhview })
+        { }
+
+        multihash(const multihash_view& mhview) : _hash(mhview.hash()), _size(gsl::narrow<uint32_t>(mhview.size())), _data(mhview.data())
+        { }
+
+        // Construct from a temporary buffer
+        //    The bytes are stored inline when they fit in hashbuffer_t.
+        multihash(buffer_t&& mhbuffer) : _data(mhbuffer)
+        {
+            auto size = size_t{};
+            _hash = details::hash_entry(details::parse_multihash(_data, &size)).key;
+            _size = gsl::narrow<uint32_t>(size);
+        }
+
+        // Construct from a digest whose length is already verified
+        //    The binary multihash is written directly in the inline storage.
+        multihash(hash_t hash, uint32_t code, bufferview_t digest, details::verified_t) : _hash(hash), _size(gsl::narrow<uint32_t>(digest.size()))
+        {
+            byte_t header[2 * uvarint::max_varint_size];
+            auto last = uvarint::encode(code, header);
+            last = uvarint::encode(_size, last);
+
+            auto ptr = _data.allocate((last - header) + _size);
+            ptr = std::copy(header, last, ptr);
+            std::copy(digest.begin(), digest.end(), ptr);
         }
 
         hash_t       hash()   const { return _hash; }
@@ -416,32 +764,441 @@ namespace multiformats {
         bufferview_t digest() const { return bufferview_t{ _data }.last(_size); }
 
         bufferview_t data()   const { return _data; }
+        multihash_view view() const { return { _hash, _size, _data }; }
 
 
     private:
         hash_t _hash;
-        size_t _size;
-        buffer_t _data;
+        uint32_t _size;
+        hashbuffer_t _data;
     };
 
-    // Create a multihash from a digest_buffer
-    template <hash_t _Hash>
-    multihash to_multihash(digest_buffer<_Hash> digest) {
-        auto mh = buffer_t{};
+    //
+    // Incremental computation of a digest
+    //
+    class hasher
+    {
+    public:
+        // The backend of the hash function is selected at construction
+        explicit hasher(hash_t hash) : _hash(hash), _impl(details::hash_registry::instance().backend(_hash.index())), _context{} { reset(); }
+
+        // The context may own resources of the backend, so a hasher is moved but not copied
+        hasher(hasher&& _Right) : _hash(_Right._hash), _impl(_Right._impl), _context(_Right._context) { _Right._impl.release = nullptr; }
+        hasher(const hasher&) = delete;
+        hasher& operator=(const hasher&) = delete;
+        ~hasher() { if (_impl.release) _impl.release(_context); }
+
+        void reset() { _impl.init(_context); }
+        void update(bufferview_t data) { _impl.update(_context, data); }
+
+        // Write the digest in out (at least size() bytes) and reset the computation
+        void final(byte_t* out) 
+        { 
+            _impl.final(_context, out);
+            reset();
+        }
 
-        uvarint::encode(digest.code(), std::back_inserter(mh));
-        uvarint::encode(digest.size(), std::back_inserter(mh));
-        mh.insert(mh.end(), digest.begin(), digest.end());
+        digest_buffer<> digest()
+        {
+            byte_t out[max_digest_size];
+            final(out);
+            return { hash(), bufferview_t{ out, size() } };
+        }
 
-        return { mh };
+        hash_t   hash() const { return _hash.hash(); }
+        uint32_t code() const { return _hash.code(); }
+        int32_t  size() const { return _hash.len(); }
+
+    private:
+        const details::hashcode_type<> _hash;
+        details::hash_backend _impl;
+        details::hash_context _context;
+    };
+
+    // Compute the digest of data
+    inline digest_buffer<> compute_digest(hash_t hash, bufferview_t data)
+    {
+        auto h = hasher{ hash };
+        h.update(data);
+        return h.digest();
+    }
+
+    // Compute the multihash of data
+    inline multihash compute_multihash(hash_t hash, bufferview_t data)
+    {
+        auto h = hasher{ hash };
+        byte_t out[max_digest_size];
+        h.update(data);
+        h.final(out);
+        return { hash, h.code(), bufferview_t{ out, h.size() }, details::verified };
+    }
+
+    // Compute the multihash of data, with the digest truncated to its first size bytes
+    inline multihash compute_multihash(hash_t hash, bufferview_t data, size_t size)
+    {
+        auto h = hasher{ hash };
+        Expects(size > 0 && size <= static_cast<size_t>(h.size()));
+        byte_t out[max_digest_size];
+        h.update(data);
+        h.final(out);
+        return { hash, h.code(), bufferview_t{ out, static_cast<ptrdiff_t>(size) }, details::verified };
+    }
+
+
+    //
+    // Batch computation of multihashes on a thread pool
+    //   Consecutive inputs are grouped in tasks of at least batch_task_size bytes, so that small buffers
+    //   are not scheduled one by one. The results are in the same order as the inputs.
+    //
+    constexpr size_t batch_task_size = 256 * 1024;
+
+    std::vector<multihash> compute_multihashes(hash_t hash, gsl::span<const bufferview_t> inputs, thread_pool& pool = default_thread_pool());
+
+    // Same as above for consecutive chunks of data: boundaries are the end offsets of the chunks
+    std::vector<multihash> compute_multihashes(hash_t hash, bufferview_t data, gsl::span<const size_t> boundaries, thread_pool& pool = default_thread_pool());
+
+
+    namespace details {
+
+        // Compare two buffers in a time that only depends on their sizes
+        inline bool constant_time_equal(bufferview_t _Left, bufferview_t _Right)
+        {
+            if (_Left.size() != _Right.size()) return false;
+
+            auto diff = byte_t{ 0 };
+            for (auto i = ptrdiff_t{ 0 }; i < _Left.size(); i++)
+                diff |= _Left[i] ^ _Right[i];
+            return diff == 0;
+        }
+
+        // Lexicographic comparison of two buffers
+        inline int compare(bufferview_t _Left, bufferview_t _Right)
+        {
+            auto minsize = static_cast<size_t>(std::min(_Left.size(), _Right.size()));
+            auto cmp = minsize ? std::memcmp(_Left.data(), _Right.data(), minsize) : 0;
+            if (cmp != 0) return cmp;
+            return (_Left.size() < _Right.size()) ? -1 : (_Left.size() > _Right.size()) ? 1 : 0;
+        }
+
+        // 64-bit hash value of a digest
+        //    The output of a cryptographic hash function is already uniformly distributed, so its leading bytes
+        //    are used as is. Shorter digests (identity hash...) are folded with FNV-1a.
+        inline uint64_t digest_key(bufferview_t digest)
+        {
+            auto value = uint64_t{};
+            if (digest.size() >= static_cast<ptrdiff_t>(sizeof(value))) {
+                std::memcpy(&value, digest.data(), sizeof(value));
+                return value;
+            }
+
+            value = 14695981039346656037ULL;
+            for (auto b : digest) {
+                value ^= b;
+                value *= 1099511628211ULL;
+            }
+            return value;
+        }
+
+        inline size_t digest_hash(bufferview_t digest) { return static_cast<size_t>(digest_key(digest)); }
+    }
+
+    // Comparison operators
+    //    Multihashes are compared on their binary representation, so they can be used as keys in ordered containers.
+    //    Use constant_time_equal() when the comparison must not leak timing information.
+    inline bool operator==(const multihash_view& _Left, const multihash_view& _Right) { return details::compare(_Left.data(), _Right.data()) == 0; }
+    inline bool operator!=(const multihash_view& _Left, const multihash_view& _Right) { return !(_Left == _Right); }
+    inline bool operator< (const multihash_view& _Left, const multihash_view& _Right) { return details::compare(_Left.data(), _Right.data()) < 0; }
+
+    inline bool operator==(const multihash& _Left, const multihash& _Right) { return details::compare(_Left.data(), _Right.data()) == 0; }
+    inline bool operator!=(const multihash& _Left, const multihash& _Right) { return !(_Left == _Right); }
+    inline bool operator< (const multihash& _Left, const multihash& _Right) { return details::compare(_Left.data(), _Right.data()) < 0; }
+
+    inline bool constant_time_equal(const multihash_view& _Left, const multihash_view& _Right) { return details::constant_time_equal(_Left.data(), _Right.data()); }
+    inline bool constant_time_equal(const multihash& _Left, const multihash& _Right) { return details::constant_time_equal(_Left.data(), _Right.data()); }
+
+    //
+    // Truncated digests
+    //   The multihash spec allows a digest to be truncated to its leading bytes. A truncated multihash does not
+    //   compare equal to the full one; use these helpers to match them without building another multihash.
+    //
+
+    // Return true if both multihashes use the same hash function and the shorter digest is a prefix of the longer one
+    inline bool truncated_equal(const multihash_view& _Left, const multihash_view& _Right)
+    {
+        if (_Left.hash() != _Right.hash()) return false;
+        auto size = static_cast<ptrdiff_t>(std::min(_Left.size(), _Right.size()));
+        return _Left.digest().first(size) == _Right.digest().first(size);
+    }
+    inline bool truncated_equal(const multihash& _Left, const multihash& _Right) { return truncated_equal(_Left.view(), _Right.view()); }
+
+    // Ordering on the hash function then on the common prefix of the digests.
+    //    In a container where all the digests of a hash function have the same size, equal_range() with a
+    //    truncated multihash returns all the entries that start with its digest.
+    struct digest_prefix_less
+    {
+        using is_transparent = void;
+
+        bool operator()(const multihash_view& _Left, const multihash_view& _Right) const
+        {
+            if (_Left.hash() != _Right.hash()) return _Left.hash() < _Right.hash();
+            auto size = static_cast<ptrdiff_t>(std::min(_Left.size(), _Right.size()));
+            return details::compare(_Left.digest().first(size), _Right.digest().first(size)) < 0;
+        }
+        bool operator()(const multihash& _Left, const multihash& _Right) const      { return (*this)(_Left.view(), _Right.view()); }
+        bool operator()(const multihash& _Left, const multihash_view& _Right) const { return (*this)(_Left.view(), _Right); }
+        bool operator()(const multihash_view& _Left, const multihash& _Right) const { return (*this)(_Left, _Right.view()); }
+    };
+
+    //
+    // Integrity checking of multihash-addressed content
+    //
+    enum comparison_t {
+        constant_time,  // the comparison time does not depend on the content (adversarial inputs)
+        early_exit      // the comparison stops at the first difference
+    };
+
+    // Verify content while it is read, in one or more parts
+    class verifier
+    {
+    public:
+        verifier(const multihash_view& expected) : _expected(expected), _hasher(expected.hash())
+        { }
+        verifier(const multihash& expected) : verifier(expected.view())
+        { }
+
+        void update(bufferview_t content) { _hasher.update(content); }
+
+        // Copy src into dst and hash it in the same pass, block by block while it is in cache.
+        // Returns the part of dst that follows the copied bytes.
+        gsl::span<byte_t> update(bufferview_t src, gsl::span<byte_t> dst)
+        {
+            if (dst.size() < src.size()) throw std::invalid_argument("Destination buffer is too small");
+
+            constexpr auto block = ptrdiff_t{ 16 * 1024 };
+            for (auto pos = ptrdiff_t{ 0 }; pos < src.size(); pos += block) {
+                auto n = std::min(block, src.size() - pos);
+                std::memcpy(dst.data() + pos, src.data() + pos, static_cast<size_t>(n));
+                _hasher.update(bufferview_t{ dst.data() + pos, n });
+            }
+            return dst.last(dst.size() - src.size());
+        }
+
+        // Return true if the content read so far matches the expected digest, and reset the verifier
+        bool verify(comparison_t comparison = constant_time)
+        {
+            byte_t out[max_digest_size];
+            _hasher.final(out);
+
+            // a truncated digest is compared with the leading bytes of the full one
+            auto digest = bufferview_t{ out, static_cast<ptrdiff_t>(_expected.size()) };
+            if (comparison == early_exit) return digest == _expected.digest();
+            return details::constant_time_equal(digest, _expected.digest());
+        }
+
+    private:
+        multihash _expected;
+        hasher _hasher;
+    };
+
+    // Return true if content matches the multihash
+    inline bool verify(const multihash_view& mh, bufferview_t content, comparison_t comparison = constant_time)
+    {
+        auto v = verifier{ mh };
+        v.update(content);
+        return v.verify(comparison);
+    }
+    inline bool verify(const multihash& mh, bufferview_t content, comparison_t comparison = constant_time)
+    {
+        return verify(mh.view(), content, comparison);
+    }
+
+    // Copy content into dst and return true if it matches the multihash, in a single pass over memory
+    inline bool verify_copy(const multihash_view& mh, bufferview_t content, gsl::span<byte_t> dst, comparison_t comparison = constant_time)
+    {
+        auto v = verifier{ mh };
+        v.update(content, dst);
+        return v.verify(comparison);
+    }
+    inline bool verify_copy(const multihash& mh, bufferview_t content, gsl::span<byte_t> dst, comparison_t comparison = constant_time)
+    {
+        return verify_copy(mh.view(), content, dst, comparison);
+    }
+
+
+    // Create a multihash from a digest_buffer
+    //    The length of a digest_buffer<> is verified at construction.
+    template <hash_t _Hash>
+    multihash to_multihash(const digest_buffer<_Hash>& digest) 
+    {
+        Expects(!digest.empty());
+        return { digest.hash(), digest.code(), digest.data(), details::verified };
     }
 
     // Create a multihash from a digest_string
     template <hash_t _Hash, base_t _Base>
-    multihash to_multihash(digest_string<_Hash, _Base> digest) { return to_multihash(decode(digest)); }
+    multihash to_multihash(const digest_string<_Hash, _Base>& digest) { return to_multihash(decode(digest)); }
 
-    // Create a multihash from a raw digest_string
+    // Create a multihash from a raw digest
+    inline multihash to_multihash(hash_t hash, bufferview_t digest) 
+    {
+        auto type = details::hashcode_type<>{ hash };
+        Expects(!digest.empty());
+        Expects(type.len() < 0 || digest.size() <= type.len());
+        return { hash, type.code(), digest, details::verified };
+    }
     template <hash_t _Hash>
-    multihash to_multihash(bufferview_t digest) { return to_multihash(digest_buffer<_Hash>{ digest }); }
-    inline multihash to_multihash(hash_t hash, bufferview_t digest) { return to_multihash(digest_buffer<>{ hash, digest }); }
+    multihash to_multihash(bufferview_t digest) { return to_multihash(_Hash, digest); }
+
+
+    //
+    // Compile-time multihashes
+    //
+
+    // A binary multihash held in a literal type, so that well-known multihashes (peer IDs, genesis blocks...)
+    // are parsed and statically initialized at compile-time (see the _mh and _mh16 literals).
+    class static_multihash
+    {
+    public:
+        static constexpr size_t capacity = 2 * uvarint::max_varint_size + max_digest_size;
+
+        constexpr static_multihash() : _hash(dynamic_hash), _size(0), _length(0), _data{}
+        { }
+
+        constexpr hash_t hash()   const { return _hash; }
+        constexpr size_t size()   const { return _size; }
+        constexpr size_t length() const { return _length; }
+        constexpr byte_t operator[](size_t pos) const { return _data[pos]; }
+
+        bufferview_t digest() const { return data().last(_size); }
+        bufferview_t data()   const { return { _data, static_cast<ptrdiff_t>(_length) }; }
+        multihash_view view() const { return { _hash, _size, data() }; }
+
+    private:
+        hash_t _hash;
+        size_t _size;
+        size_t _length;
+        byte_t _data[capacity];
+
+        friend constexpr static_multihash parse_static_multihash(base_t base, const char* str, size_t len);
+    };
+
+    namespace details {
+
+        constexpr int static_digit(const char* digits, char c) {
+            for (auto i = 0; digits[i]; i++)
+                if (digits[i] == c) return i;
+            return -1;
+        }
+
+        // Only the letters are folded, so that no other character is taken for a digit
+        constexpr int static_hex_digit(char c) {
+            return static_digit("0123456789abcdef", (c >= 'A' && c <= 'F') ? static_cast<char>(c | 0x20) : c);
+        }
+
+        // Decode a base16 (either case) or base58btc string into out, and return the number of bytes written
+        constexpr size_t static_decode(base_t base, const char* str, size_t len, byte_t* out, size_t capacity)
+        {
+            if (base == base16) {
+                if (len % 2 != 0 || len / 2 > capacity) throw std::invalid_argument("Failed to parse multihash string: wrong size");
+                for (size_t i = 0; i < len; i += 2) {
+                    auto hi = static_hex_digit(str[i]);
+                    auto lo = static_hex_digit(str[i + 1]);
+                    if (hi < 0 || lo < 0) throw std::invalid_argument("Failed to parse multihash string: invalid digit");
+                    out[i / 2] = static_cast<byte_t>(hi * 16 + lo);
+                }
+                return len / 2;
+            }
+
+            if (base == base58btc) {
+                const auto digits = _BaseTable[find_baseimpl(base58btc)].digits;
+
+                // big-endian accumulation at the end of out, leading zero digits are leading zero bytes
+                auto zeros = size_t{ 0 };
+                while (zeros < len && str[zeros] == digits[0]) zeros++;
+
+                auto size = size_t{ 0 };
+                for (auto i = zeros; i < len; i++) {
+                    auto d = static_digit(digits, str[i]);
+                    if (d < 0) throw std::invalid_argument("Failed to parse multihash string: invalid digit");
+
+                    auto carry = static_cast<uint32_t>(d);
+                    for (size_t j = 0; j < size; j++) {
+                        carry += 58 * out[capacity - 1 - j];
+                        out[capacity - 1 - j] = static_cast<byte_t>(carry);
+                        carry >>= 8;
+                    }
+                    for (; carry; carry >>= 8) {
+                        if (size == capacity) throw std::invalid_argument("Failed to parse multihash string: wrong size");
+                        out[capacity - 1 - size++] = static_cast<byte_t>(carry);
+                    }
+                }
+                if (zeros + size > capacity) throw std::invalid_argument("Failed to parse multihash string: wrong size");
+
+                for (size_t i = 0; i < size; i++) out[zeros + i] = out[capacity - size + i];
+                for (size_t i = 0; i < zeros; i++) out[i] = 0;
+                return zeros + size;
+            }
+
+            throw std::invalid_argument("Failed to parse multihash string: unsupported base");
+        }
+
+        // constexpr counterpart of uvarint::decode
+        constexpr size_t static_uvarint(const byte_t* data, size_t len, size_t* pPos)
+        {
+            auto value = uint64_t{ 0 };
+            for (size_t i = 0; i < uvarint::max_varint_size; i++) {
+                if (*pPos == len) throw std::invalid_argument("Failed to parse multihash buffer: wrong size");
+                auto b = data[(*pPos)++];
+                value = (value << 7) | (b & 0x7F);
+                if (!(b & 0x80)) return static_cast<size_t>(value);
+            }
+            throw std::invalid_argument("Failed to parse multihash buffer: wrong size");
+        }
+    }
+
+    // Parse a base16 or base58btc multihash string
+    //    Same checks as details::parse_multihash; when evaluated at compile-time, an invalid string is a compilation error.
+    constexpr static_multihash parse_static_multihash(base_t base, const char* str, size_t len)
+    {
+        auto mh = static_multihash{};
+        mh._length = details::static_decode(base, str, len, mh._data, static_multihash::capacity);
+
+        auto pos = size_t{ 0 };
+        auto index = details::find_hashimpl_by_code(static_cast<uint32_t>(details::static_uvarint(mh._data, mh._length, &pos)));
+        if (index == 0) throw std::invalid_argument("Failed to parse multihash buffer: wrong hash code");
+
+        auto size = details::static_uvarint(mh._data, mh._length, &pos);
+        if (size != mh._length - pos) throw std::invalid_argument("Failed to parse multihash buffer: wrong size");
+        if (size == 0) throw std::invalid_argument("Failed to parse multihash buffer: wrong size");
+        if (details::_HashTable[index].len > 0 && size > static_cast<size_t>(details::_HashTable[index].len)) throw std::invalid_argument("Failed to parse multihash buffer: wrong size");
+
+        mh._hash = details::_HashTable[index].key;
+        mh._size = size;
+        return mh;
+    }
 }
+
+
+namespace std {
+
+    // Hash support for unordered containers: reuses the entropy of the digest instead of rehashing it
+    template <>
+    struct hash<multiformats::multihash_view>
+    {
+        size_t operator()(const multiformats::multihash_view& mh) const { return multiformats::details::digest_hash(mh.digest()); }
+    };
+
+    template <>
+    struct hash<multiformats::multihash>
+    {
+        size_t operator()(const multiformats::multihash& mh) const { return multiformats::details::digest_hash(mh.digest()); }
+    };
+}
+
+// Compile-time multihash literals: "Qm..."_mh (base58btc) and "1220..."_mh16 (base16)
+//    Use them to initialize a constexpr variable so that the string is parsed by the compiler.
+constexpr multiformats::static_multihash operator "" _mh(const char* s, std::size_t len)
+{ return multiformats::parse_static_multihash(multiformats::base58btc, s, len); }
+
+constexpr multiformats::static_multihash operator "" _mh16(const char* s, std::size_t len)
+{ return multiformats::parse_static_multihash(multiformats::base16, s, len); }
@@ -0,0 +1,343 @@
+#pragma once
+
+#include "multihash.h"
+
+#include <algorithm>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+namespace multiformats {
+
+    namespace details {
+
+        // Map a 32-bit value uniformly to [0, range) without a division
+        inline uint32_t reduce(uint32_t value, uint32_t range) { return static_cast<uint32_t>((uint64_t{ value } * range) >> 32); }
+
+        // Header of a saved filter image, followed by the filter payload
+        //    The image is written in the native byte order so that a memory-mapped file can be queried in place.
+        struct filter_header {
+            uint64_t magic;
+            uint64_t count;     // number of keys
+            uint64_t seed;
+            uint64_t length;    // number of payload elements
+        };
+
+        // Storage of a filter image: owned, or borrowed from an external buffer (memory-mapped file...)
+        class filter_image
+        {
+        public:
+            const filter_header& header() const { return *reinterpret_cast<const filter_header*>(data()); }
+            bufferview_t image() const { return { data(), static_cast<ptrdiff_t>(_size) }; }
+
+            // Write the image to a stream
+            void save(std::ostream& os) const
+            {
+                os.write(reinterpret_cast<const char*>(data()), _size);
+                if (!os) throw std::runtime_error("Failed to write filter image");
+            }
+
+        protected:
+            filter_image() = default;
+
+            // Allocate an owned image with a zeroed payload
+            void allocate(uint64_t magic, uint64_t count, uint64_t seed, uint64_t length, size_t element_size)
+            {
+                _size = sizeof(filter_header) + static_cast<size_t>(length) * element_size;
+                _storage.assign((_size + 7) / 8, 0);
+                _external = nullptr;
+                *reinterpret_cast<filter_header*>(_storage.data()) = { magic, count, seed, length };
+            }
+
+            // Borrow an external image after checking its header
+            //    The payload must be a positive multiple of granule elements, with less than 2^32 granules.
+            void wrap(bufferview_t image, uint64_t magic, size_t element_size, uint64_t granule)
+            {
+                Expects(reinterpret_cast<uintptr_t>(image.data()) % alignof(filter_header) == 0);
+                if (!valid(image, magic, element_size, granule)) throw std::invalid_argument("Invalid filter image");
+                _storage.clear();
+                _external = image.data();
+                _size = static_cast<size_t>(image.size());
+            }
+
+            // Read an image from a stream into owned storage, with the same checks as wrap()
+            void read(std::istream& is, uint64_t magic, size_t element_size, uint64_t granule)
+            {
+                auto header = filter_header{};
+                if (!is.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.magic != magic || !valid_length(header, element_size, granule))
+                    throw std::invalid_argument("Invalid filter image");
+
+                allocate(header.magic, header.count, header.seed, header.length, element_size);
+                if (!is.read(reinterpret_cast<char*>(payload()), _size - sizeof(header)))
+                    throw std::invalid_argument("Invalid filter image");
+            }
+
+            // A borrowed image is read-only
+            filter_header& mutable_header() { Expects(!_external); return *reinterpret_cast<filter_header*>(_storage.data()); }
+            const byte_t*  payload() const  { return data() + sizeof(filter_header); }
+            byte_t*        payload()        { Expects(!_external); return reinterpret_cast<byte_t*>(_storage.data()) + sizeof(filter_header); }
+
+        private:
+            const byte_t* data() const { return _external ? _external : reinterpret_cast<const byte_t*>(_storage.data()); }
+
+            // The payload size must not overflow, and an empty payload would make every query read out of bounds
+            static bool valid_length(const filter_header& header, size_t element_size, uint64_t granule)
+            {
+                return header.length != 0 && header.length % granule == 0 && header.length / granule <= UINT32_MAX
+                    && header.length <= (SIZE_MAX - sizeof(filter_header)) / element_size;
+            }
+
+            static bool valid(bufferview_t image, uint64_t magic, size_t element_size, uint64_t granule)
+            {
+                if (image.size() < static_cast<ptrdiff_t>(sizeof(filter_header))) return false;
+                auto& header = *reinterpret_cast<const filter_header*>(image.data());
+                return header.magic == magic && valid_length(header, element_size, granule)
+                    && header.length * element_size == static_cast<size_t>(image.size()) - sizeof(filter_header);
+            }
+
+            std::vector<uint64_t> _storage;
+            const byte_t* _external = nullptr;
+            size_t _size = 0;
+        };
+    }
+
+
+    //
+    // Blocked Bloom filter of multihashes
+    //    Each key sets one bit in each of the 8 words of a single 256-bit block: a query reads one cache line,
+    //    and the 8 independent word tests compile to vector code.
+    //    There is no false negative; the false positive rate is about 1.3% at 10 bits per key.
+    //
+    class bloom_filter : public details::filter_image
+    {
+    public:
+        static constexpr uint64_t magic = 0x314d4f4f4c42484dULL; // "MHBLOOM1"
+
+        // Construct an empty filter sized for count keys
+        explicit bloom_filter(size_t count, double bits_per_key = 10.0)
+        {
+            Expects(bits_per_key > 0);
+            auto blocks = static_cast<uint64_t>(count * bits_per_key / 256) + 1;
+            Expects(blocks <= UINT32_MAX);
+            allocate(magic, 0, 0, blocks * 8, sizeof(uint32_t));
+        }
+
+        // Query a saved image in place, without copy (the image must outlive the filter)
+        explicit bloom_filter(bufferview_t image) { wrap(image, magic, sizeof(uint32_t), 8); }
+
+        // Read a saved image from a stream
+        static bloom_filter load(std::istream& is)
+        {
+            auto filter = bloom_filter{};
+            filter.read(is, magic, sizeof(uint32_t), 8);
+            return filter;
+        }
+
+        size_t count() const { return static_cast<size_t>(header().count); }
+
+        void insert(const multihash_view& mh) { insert_key(details::digest_key(mh.digest())); }
+        void insert(const multihash& mh)      { insert_key(details::digest_key(mh.digest())); }
+
+        template <typename InputIt>
+        void insert(InputIt first, InputIt last) { for (; first != last; ++first) insert_key(details::digest_key(first->digest())); }
+
+        bool contains(const multihash_view& mh) const { return contains_key(details::digest_key(mh.digest())); }
+        bool contains(const multihash& mh) const      { return contains_key(details::digest_key(mh.digest())); }
+
+        // Batch membership test: results[i] is set to contains(keys[i])
+        //    Returns the number of keys that may be in the set.
+        size_t contains(gsl::span<const multihash_view> keys, gsl::span<bool> results) const { return contains_batch(keys, results); }
+        size_t contains(gsl::span<const multihash> keys, gsl::span<bool> results) const      { return contains_batch(keys, results); }
+
+    private:
+        bloom_filter() = default;
+
+        uint32_t block_count() const { return static_cast<uint32_t>(header().length / 8); }
+        uint32_t block_index(uint64_t key) const { return 8 * details::reduce(static_cast<uint32_t>(key >> 32), block_count()); }
+
+        // One bit per word, selected by the top 5 bits of the low half of the key multiplied by odd constants
+        static void masks(uint64_t key, uint32_t* mask)
+        {
+            const uint32_t salt[8] = { 0x47b6137b, 0x44974d91, 0x8824ad5b, 0xa2b7289d, 0x705495c7, 0x2df1424b, 0x9efc4947, 0x5c6bfb31 };
+            for (auto i = 0; i < 8; i++)
+                mask[i] = uint32_t{ 1 } << ((static_cast<uint32_t>(key) * salt[i]) >> 27);
+        }
+
+        void insert_key(uint64_t key)
+        {
+            uint32_t mask[8];
+            masks(key, mask);
+            auto words = reinterpret_cast<uint32_t*>(payload()) + block_index(key);
+            for (auto i = 0; i < 8; i++) words[i] |= mask[i];
+            mutable_header().count++;
+        }
+
+        bool contains_key(uint64_t key) const
+        {
+            uint32_t mask[8];
+            masks(key, mask);
+            auto words = reinterpret_cast<const uint32_t*>(payload()) + block_index(key);
+            auto missing = uint32_t{ 0 };
+            for (auto i = 0; i < 8; i++) missing |= mask[i] & ~words[i];
+            return missing == 0;
+        }
+
+        template <typename T>
+        size_t contains_batch(gsl::span<const T> keys, gsl::span<bool> results) const
+        {
+            Expects(results.size() >= keys.size());
+            auto found = size_t{ 0 };
+            for (auto i = ptrdiff_t{ 0 }; i < keys.size(); i++) {
+                auto hit = contains_key(details::digest_key(keys[i].digest()));
+                results[i] = hit;
+                found += hit;
+            }
+            return found;
+        }
+    };
+
+
+    //
+    // Static xor filter of multihashes (8-bit fingerprints)
+    //    Built once from the full set of keys; a query xors three fingerprints at independent positions.
+    //    Uses about 9.84 bits per key for a false positive rate of about 0.4%.
+    //
+    class xor_filter : public details::filter_image
+    {
+    public:
+        static constexpr uint64_t magic = 0x0038524f58484dULL; // "MHXOR8"
+
+        // Build the filter from a range of multihash or multihash_view
+        template <typename InputIt>
+        xor_filter(InputIt first, InputIt last)
+        {
+            auto keys = std::vector<uint64_t>{};
+            for (; first != last; ++first) keys.push_back(details::digest_key(first->digest()));
+            build(std::move(keys));
+        }
+
+        // Query a saved image in place, without copy (the image must outlive the filter)
+        explicit xor_filter(bufferview_t image) { wrap(image, magic, sizeof(byte_t), 3); }
+
+        // Read a saved image from a stream
+        static xor_filter load(std::istream& is)
+        {
+            auto filter = xor_filter{};
+            filter.read(is, magic, sizeof(byte_t), 3);
+            return filter;
+        }
+
+        size_t count() const { return static_cast<size_t>(header().count); }
+
+        bool contains(const multihash_view& mh) const { return contains_key(details::digest_key(mh.digest())); }
+        bool contains(const multihash& mh) const      { return contains_key(details::digest_key(mh.digest())); }
+
+        // Batch membership test: results[i] is set to contains(keys[i])
+        //    Returns the number of keys that may be in the set.
+        size_t contains(gsl::span<const multihash_view> keys, gsl::span<bool> results) const { return contains_batch(keys, results); }
+        size_t contains(gsl::span<const multihash> keys, gsl::span<bool> results) const      { return contains_batch(keys, results); }
+
+    private:
+        xor_filter() = default;
+
+        static constexpr int max_attempts = 100;
+
+        struct slots { uint32_t h[3]; byte_t fingerprint; };
+
+        // The key is remixed with the seed, so that a failed construction can be retried with another seed
+        static slots hash(uint64_t key, uint64_t seed, uint32_t block_length)
+        {
+            auto h = key + seed;
+            h = (h ^ (h >> 33)) * 0xff51afd7ed558ccdULL;
+            h = (h ^ (h >> 33)) * 0xc4ceb9fe1a85ec53ULL;
+            h ^= h >> 33;
+
+            auto rotl = [h](int n) { return static_cast<uint32_t>((h << n) | (h >> (64 - n))); };
+            return { {
+                details::reduce(static_cast<uint32_t>(h), block_length),
+                details::reduce(rotl(21), block_length) + block_length,
+                details::reduce(rotl(42), block_length) + 2 * block_length,
+            }, static_cast<byte_t>(h ^ (h >> 32)) };
+        }
+
+        uint32_t block_length() const { return static_cast<uint32_t>(header().length / 3); }
+
+        bool contains_key(uint64_t key) const
+        {
+            auto s = hash(key, header().seed, block_length());
+            auto fingerprints = payload();
+            return s.fingerprint == (fingerprints[s.h[0]] ^ fingerprints[s.h[1]] ^ fingerprints[s.h[2]]);
+        }
+
+        template <typename T>
+        size_t contains_batch(gsl::span<const T> keys, gsl::span<bool> results) const
+        {
+            Expects(results.size() >= keys.size());
+            auto found = size_t{ 0 };
+            for (auto i = ptrdiff_t{ 0 }; i < keys.size(); i++) {
+                auto hit = contains_key(details::digest_key(keys[i].digest()));
+                results[i] = hit;
+                found += hit;
+            }
+            return found;
+        }
+
+        // Peel the 3-hypergraph of the keys, then assign the fingerprints in reverse peeling order
+        //    A seed fails with a small probability, so the construction gives up after max_attempts seeds.
+        void build(std::vector<uint64_t> keys)
+        {
+            std::sort(keys.begin(), keys.end());
+            keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+            const auto count = keys.size();
+            const auto capacity = static_cast<uint64_t>(32 + 1.23 * count) / 3 * 3;
+            Expects(capacity <= UINT32_MAX);
+            const auto block_length = static_cast<uint32_t>(capacity / 3);
+
+            auto xormask = std::vector<uint64_t>(capacity);
+            auto degree = std::vector<uint32_t>(capacity);
+            auto stack = std::vector<std::pair<uint64_t, uint32_t>>{};   // (key, slot) in peeling order
+            auto queue = std::vector<uint32_t>{};
+            stack.reserve(count);
+
+            auto seed = uint64_t{ 0x726b2b9d438b9d4dULL };
+            for (auto attempt = 0; attempt < max_attempts; attempt++, seed += 0x9E3779B97F4A7C15ULL) {
+                std::fill(xormask.begin(), xormask.end(), 0);
+                std::fill(degree.begin(), degree.end(), 0);
+                stack.clear();
+                queue.clear();
+
+                for (auto key : keys) {
+                    auto s = hash(key, seed, block_length);
+                    for (auto h : s.h) { xormask[h] ^= key; degree[h]++; }
+                }
+                for (uint32_t i = 0; i < capacity; i++)
+                    if (degree[i] == 1) queue.push_back(i);
+
+                while (!queue.empty()) {
+                    auto slot = queue.back();
+                    queue.pop_back();
+                    if (degree[slot] != 1) continue;
+
+                    auto key = xormask[slot];
+                    stack.emplace_back(key, slot);
+                    for (auto h : hash(key, seed, block_length).h) {
+                        xormask[h] ^= key;
+                        if (--degree[h] == 1) queue.push_back(h);
+                    }
+                }
+
+                if (stack.size() == count) {
+                    allocate(magic, count, seed, capacity, sizeof(byte_t));
+                    auto fingerprints = payload();
+                    for (auto it = stack.rbegin(); it != stack.rend(); ++it) {
+                        auto s = hash(it->first, seed, block_length);
+                        fingerprints[it->second] = s.fingerprint ^ fingerprints[s.h[0]] ^ fingerprints[s.h[1]] ^ fingerprints[s.h[2]];
+                    }
+                    return;
+                }
+            }
+            throw std::runtime_error("Failed to build xor filter");
+        }
+    };
+}
@@ -0,0 +1,260 @@
+#pragma once
+
+#include "multihash.h"
+
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+namespace multiformats {
+
+    //
+    // A compact set of multihashes for membership tests
+    //    The digests are stored without their header in one contiguous sorted array per hash function
+    //    and digest size, so an entry costs its digest bytes and no allocation of its own.
+    //
+    class multihash_set
+    {
+    public:
+        multihash_set() = default;
+
+        template <typename InputIt>
+        multihash_set(InputIt first, InputIt last) { insert(first, last); }
+
+        size_t size() const
+        {
+            auto count = size_t{ 0 };
+            for (auto& g : _groups) count += g.count();
+            return count;
+        }
+        bool empty() const { return size() == 0; }
+
+        // Heap bytes used by the set
+        size_t memory_usage() const
+        {
+            auto bytes = _groups.capacity() * sizeof(group);
+            for (auto& g : _groups) bytes += g.digests.capacity() + g.buckets.capacity() * sizeof(uint32_t);
+            return bytes;
+        }
+
+        void clear() { _groups.clear(); }
+        void shrink_to_fit()
+        {
+            for (auto& g : _groups) {
+                g.digests.shrink_to_fit();
+                g.buckets.shrink_to_fit();
+            }
+        }
+
+        // Insert a single multihash in place (linear in the size of its group)
+        //    Returns false if it was already in the set.
+        bool insert(const multihash_view& mh)
+        {
+            auto& g = get_group(mh.hash(), mh.size());
+            auto key = mh.digest().data();
+            auto pos = g.lower_bound(key);
+            if (pos != g.end() && std::memcmp(pos, key, g.size) == 0) return false;
+
+            auto offset = pos - g.digests.data();
+            g.digests.insert(g.digests.begin() + offset, key, key + g.size);
+            for (auto b = g.bucket(key) + 1; b < g.buckets.size(); b++) g.buckets[b]++;
+            return true;
+        }
+        bool insert(const multihash& mh) { return insert(mh.view()); }
+
+        // Insert a range of multihash or multihash_view
+        //    The new digests are appended, then sorted and merged once per group.
+        template <typename InputIt>
+        void insert(InputIt first, InputIt last)
+        {
+            auto sorted = std::vector<size_t>(_groups.size());
+            for (size_t i = 0; i < _groups.size(); i++) sorted[i] = _groups[i].count();
+
+            for (; first != last; ++first) {
+                auto mh = view_of(*first);
+                auto& g = get_group(mh.hash(), mh.size());
+                auto digest = mh.digest();
+                g.digests.insert(g.digests.end(), digest.begin(), digest.end());
+            }
+
+            sorted.resize(_groups.size(), 0);
+            for (size_t i = 0; i < _groups.size(); i++)
+                if (_groups[i].count() != sorted[i]) _groups[i].merge_tail(sorted[i]);
+        }
+
+        bool contains(const multihash_view& mh) const
+        {
+            auto g = find_group(mh.hash(), mh.size());
+            if (!g) return false;
+
+            auto key = mh.digest().data();
+            auto pos = g->lower_bound(key);
+            return pos != g->end() && std::memcmp(pos, key, g->size) == 0;
+        }
+        bool contains(const multihash& mh) const { return contains(mh.view()); }
+
+        // Batch membership test: results[i] is set to contains(keys[i])
+        //    The searches of several keys are interleaved so that their cache misses overlap.
+        //    Returns the number of keys found.
+        size_t contains(gsl::span<const multihash_view> keys, gsl::span<bool> results) const { return contains_batch(keys, results); }
+        size_t contains(gsl::span<const multihash> keys, gsl::span<bool> results) const { return contains_batch(keys, results); }
+
+    private:
+        // The sorted digests of one hash function and digest size
+        //    The leading bits of the digests, which are uniformly distributed, index the start of each bucket
+        //    in the array, so a search only runs over a few neighbouring entries.
+        struct group
+        {
+            hash_t hash;
+            size_t size;
+            std::vector<byte_t> digests;
+            int bits = 0;
+            std::vector<uint32_t> buckets = { 0, 0 };
+
+            size_t count() const { return digests.size() / size; }
+            const byte_t* end() const { return digests.data() + digests.size(); }
+
+            size_t bucket(const byte_t* key) const
+            {
+                auto prefix = uint32_t{ 0 };
+                for (size_t i = 0; i < 4; i++) prefix = (prefix << 8) | (i < size ? key[i] : 0);
+                return bits ? prefix >> (32 - bits) : 0;
+            }
+
+            // Rebuild the bucket index for about 4 entries per bucket
+            void index()
+            {
+                const auto n = count();
+                bits = 0;
+                while (bits < 24 && (size_t{ 4 } << bits) < n) bits++;
+
+                buckets.assign((size_t{ 1 } << bits) + 1, 0);
+                auto b = size_t{ 0 };
+                for (size_t i = 0; i < n; i++) {
+                    auto last = bucket(digests.data() + i * size);
+                    while (b < last) buckets[++b] = static_cast<uint32_t>(i);
+                }
+                while (b + 1 < buckets.size()) buckets[++b] = static_cast<uint32_t>(n);
+            }
+
+            // Branchless binary search in the bucket of key: the loop count only depends on the size of the bucket
+            const byte_t* lower_bound(const byte_t* key) const
+            {
+                auto b = bucket(key);
+                auto base = digests.data() + buckets[b] * size;
+                auto n = size_t{ buckets[b + 1] - buckets[b] };
+                if (n == 0) return base;
+
+                while (n > 1) {
+                    auto half = n / 2;
+                    base = (std::memcmp(base + half * size, key, size) < 0) ? base + half * size : base;
+                    n -= half;
+                }
+                return base + ((std::memcmp(base, key, size) < 0) ? size : 0);
+            }
+
+            // Sort the digests appended after the first sorted ones and merge them, dropping duplicates
+            void merge_tail(size_t sorted)
+            {
+                auto records = digests.data();
+                auto less = [&](size_t a, size_t b) { return std::memcmp(records + a * size, records + b * size, size) < 0; };
+
+                auto order = std::vector<size_t>(count() - sorted);
+                std::iota(order.begin(), order.end(), sorted);
+                std::sort(order.begin(), order.end(), less);
+
+                auto merged = std::vector<byte_t>{};
+                merged.reserve(digests.size());
+                auto append = [&](size_t at) {
+                    auto record = records + at * size;
+                    if (merged.empty() || std::memcmp(&*(merged.end() - size), record, size) != 0)
+                        merged.insert(merged.end(), record, record + size);
+                };
+
+                auto i = size_t{ 0 };
+                for (auto j : order) {
+                    for (; i < sorted && !less(j, i); i++) append(i);
+                    append(j);
+                }
+                for (; i < sorted; i++) append(i);
+
+                digests.swap(merged);
+                index();
+            }
+        };
+
+        static multihash_view view_of(const multihash_view& mh) { return mh; }
+        static multihash_view view_of(const multihash& mh)      { return mh.view(); }
+
+        const group* find_group(hash_t hash, size_t size) const
+        {
+            for (auto& g : _groups)
+                if (g.hash == hash && g.size == size) return &g;
+            return nullptr;
+        }
+        group& get_group(hash_t hash, size_t size)
+        {
+            for (auto& g : _groups)
+                if (g.hash == hash && g.size == size) return g;
+            _groups.push_back({ hash, size, {} });
+            return _groups.back();
+        }
+
+        template <typename T>
+        size_t contains_batch(gsl::span<const T> keys, gsl::span<bool> results) const
+        {
+            Expects(results.size() >= keys.size());
+            constexpr size_t lanes = 8;
+
+            const auto count = static_cast<size_t>(keys.size());
+            auto found = size_t{ 0 };
+            for (size_t first = 0; first < count; first += lanes) {
+                const auto width = std::min(lanes, count - first);
+
+                const group*  g[lanes];
+                const byte_t* key[lanes];
+                const byte_t* base[lanes];
+                size_t        n[lanes];
+                for (size_t l = 0; l < width; l++) {
+                    auto mh = view_of(keys[first + l]);
+                    g[l] = find_group(mh.hash(), mh.size());
+                    key[l] = mh.digest().data();
+                    base[l] = nullptr;
+                    n[l] = 0;
+                    if (g[l]) {
+                        auto b = g[l]->bucket(key[l]);
+                        base[l] = g[l]->digests.data() + g[l]->buckets[b] * g[l]->size;
+                        n[l] = g[l]->buckets[b + 1] - g[l]->buckets[b];
+                    }
+                }
+
+                // one step of every search per iteration
+                for (auto active = true; active; ) {
+                    active = false;
+                    for (size_t l = 0; l < width; l++) {
+                        if (n[l] <= 1) continue;
+                        auto half = n[l] / 2;
+                        auto size = g[l]->size;
+                        base[l] = (std::memcmp(base[l] + half * size, key[l], size) < 0) ? base[l] + half * size : base[l];
+                        n[l] -= half;
+                        active = true;
+                    }
+                }
+
+                for (size_t l = 0; l < width; l++) {
+                    auto hit = false;
+                    if (n[l] == 1) {
+                        auto size = g[l]->size;
+                        auto pos = base[l] + ((std::memcmp(base[l], key[l], size) < 0) ? size : 0);
+                        hit = pos != g[l]->end() && std::memcmp(pos, key[l], size) == 0;
+                    }
+                    results[first + l] = hit;
+                    found += hit;
+                }
+            }
+            return found;
+        }
+
+        std::vector<group> _groups;
+    };
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace multiformats {
+
+    //
+    // A fixed set of worker threads used by the batch APIs
+    //
+    class thread_pool
+    {
+    public:
+        // Construct with the given number of workers (0 runs every task on the calling thread)
+        explicit thread_pool(size_t threads = std::thread::hardware_concurrency())
+        {
+            for (size_t i = 0; i < threads; i++)
+                _workers.emplace_back([this] { work(); });
+        }
+
+        ~thread_pool()
+        {
+            {
+                auto lock = std::unique_lock<std::mutex>{ _mutex };
+                _stop = true;
+            }
+            _wakeup.notify_all();
+            for (auto& worker : _workers) worker.join();
+        }
+
+        thread_pool(const thread_pool&) = delete;
+        thread_pool& operator=(const thread_pool&) = delete;
+
+        size_t size() const { return _workers.size(); }
+
+        // Call task(i) for each i in [0, count) and wait for all the calls to return.
+        // The calling thread takes part in the work. The first exception thrown by a task is rethrown here.
+        //    The caller only waits for the helpers that have started, so that a nested call from a worker does not
+        //    wait for helpers queued behind it: a helper that starts once every index is claimed returns at once.
+        template <class Func>
+        void parallel_for(size_t count, Func&& task)
+        {
+            if (count == 0) return;
+
+            // the queued helpers may outlive the call, so they share the state but only use task once started
+            struct batch_state {
+                std::atomic<size_t> next{ 0 };
+                std::mutex          mutex;
+                std::condition_variable done;
+                size_t              running = 0;
+                std::exception_ptr  error;
+            };
+            auto state = std::make_shared<batch_state>();
+
+            auto run = [count, &task](batch_state& s) {
+                for (auto i = s.next++; i < count; i = s.next++) {
+                    try {
+                        task(i);
+                    }
+                    catch (...) {
+                        auto lock = std::unique_lock<std::mutex>{ s.mutex };
+                        if (!s.error) s.error = std::current_exception();
+                        s.next = count;
+                    }
+                }
+            };
+
+            const auto helpers = std::min(_workers.size(), count - 1);
+            for (size_t i = 0; i < helpers; i++) {
+                post([state, run, count] {
+                    {
+                        auto lock = std::unique_lock<std::mutex>{ state->mutex };
+                        if (state->next >= count) return;
+                        state->running++;
+                    }
+                    run(*state);
+                    auto lock = std::unique_lock<std::mutex>{ state->mutex };
+                    if (--state->running == 0) state->done.notify_one();
+                });
+            }
+
+            run(*state);
+
+            // every index is claimed: a helper that has not started yet will not start any task
+            auto lock = std::unique_lock<std::mutex>{ state->mutex };
+            state->done.wait(lock, [&] { return state->running == 0; });
+            if (state->error) std::rethrow_exception(state->error);
+        }
+
+    private:
+        void post(std::function<void()> job)
+        {
+            {
+                auto lock = std::unique_lock<std::mutex>{ _mutex };
+                _jobs.push_back(std::move(job));
+            }
+            _wakeup.notify_one();
+        }
+
+        void work()
+        {
+            for (;;) {
+                auto job = std::function<void()>{};
+                {
+                    auto lock = std::unique_lock<std::mutex>{ _mutex };
+                    _wakeup.wait(lock, [this] { return _stop || !_jobs.empty(); });
+                    if (_jobs.empty()) return;
+                    job = std::move(_jobs.front());
+                    _jobs.pop_front();
+                }
+                job();
+            }
+        }
+
+        std::vector<std::thread> _workers;
+        std::deque<std::function<void()>> _jobs;
+        std::mutex _mutex;
+        std::condition_variable _wakeup;
+        bool _stop = false;
+    };
+
+    // Pool shared by the batch APIs when none is given, with one worker per hardware thread
+    inline thread_pool& default_thread_pool()
+    {
+        static thread_pool pool;
+        return pool;
+    }
+}
@@ -32,24 +32,16 @@ namespace details {
 
         if (uvalue > max_value) throw std::out_of_range("value to encode to uvarint type is too large");
         
-        auto out = buffer_t{};
-        auto outIter = std::back_inserter(out);
-
-        *outIter++ = gsl::narrow<OutputType>(uvalue & 0x7F);
-        uvalue >>= 7;
-        while (uvalue)
-        {
-            *outIter++ = gsl::narrow<OutputType>( (uvalue & 0x7F) | 0x80 );
-            uvalue >>= 7;
-        }
+        // count the 7-bit groups, then write them from the most significant one
+        auto groups = size_t{ 1 };
+        while (groups < max_varint_size && (static_cast<uint64_t>(uvalue) >> (7 * groups)))
+            groups++;
 
-        //return std::copy(std::rbegin(out), std::rend(out), first);
-        auto begin = std::rbegin(out);
-        auto end = std::rend(out);
-        for (auto it = begin; it != end; ++it)
+        for (auto i = groups - 1; i > 0; i--)
         {
-            *outIt++ = *it;
+            *outIt++ = gsl::narrow<OutputType>( ((uvalue >> (7 * i)) & 0x7F) | 0x80 );
         }
+        *outIt++ = gsl::narrow<OutputType>(uvalue & 0x7F);
 
         return outIt;
     }
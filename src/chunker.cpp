@@ -0,0 +1,219 @@
+#include "multiformats/chunker.h"
+
+using namespace multiformats;
+
+
+namespace {
+
+    int log2_floor(size_t value)
+    {
+        auto bits = 0;
+        while (value >>= 1) bits++;
+        return bits;
+    }
+
+    void check_sizes(const chunk_sizes& sizes)
+    {
+        Expects(sizes.min > 0 && sizes.min <= sizes.avg && sizes.avg <= sizes.max);
+    }
+
+
+    // Gear table of FastCDC: 256 pseudo-random words (splitmix64)
+    struct gear_table
+    {
+        uint64_t value[256];
+
+        gear_table()
+        {
+            auto state = uint64_t{ 0 };
+            for (auto& v : value) {
+                auto z = (state += 0x9E3779B97F4A7C15ULL);
+                z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+                z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+                v = z ^ (z >> 31);
+            }
+        }
+    };
+
+    // The gear hash shifts left, so its high bits depend on the most bytes
+    uint64_t high_mask(int bits) { return bits <= 0 ? 0 : ~uint64_t{ 0 } << (64 - bits); }
+
+
+    // Tables of the Rabin fingerprint modulo an irreducible polynomial of degree 53
+    struct rabin_tables
+    {
+        static constexpr uint64_t polynomial = 0x3DA3358B4DC173ULL;
+        static constexpr int window = 64;
+
+        int shift;
+        uint64_t mod_table[256];    // reduction of the byte shifted out of the fingerprint
+        uint64_t out_table[256];    // contribution of the byte leaving the window
+
+        static int degree(uint64_t p)
+        {
+            auto d = -1;
+            for (; p; p >>= 1) d++;
+            return d;
+        }
+        static uint64_t mod(uint64_t x, uint64_t p)
+        {
+            const auto dp = degree(p);
+            for (auto d = degree(x); d >= dp; d = degree(x)) x ^= p << (d - dp);
+            return x;
+        }
+
+        rabin_tables()
+        {
+            const auto deg = degree(polynomial);
+            shift = deg - 8;
+            for (uint64_t i = 0; i < 256; i++)
+                mod_table[i] = mod(i << deg, polynomial) | (i << deg);
+            for (auto b = 0; b < 256; b++) {
+                auto fp = append(0, static_cast<byte_t>(b));
+                for (auto k = 1; k < window; k++) fp = append(fp, 0);
+                out_table[b] = fp;
+            }
+        }
+
+        uint64_t append(uint64_t fp, byte_t b) const { return ((fp << 8) | b) ^ mod_table[fp >> shift]; }
+    };
+}
+
+
+chunker_t multiformats::fastcdc_chunker(chunk_sizes sizes)
+{
+    check_sizes(sizes);
+    static const gear_table gear;
+
+    const auto bits = log2_floor(sizes.avg);
+    const auto normal = size_t{ 1 } << bits;
+    const auto mask_s = high_mask(bits + 1);
+    const auto mask_l = high_mask(bits - 1);
+
+    return [sizes, normal, mask_s, mask_l](bufferview_t data, bool last) -> size_t {
+        const auto size = static_cast<size_t>(data.size());
+        if (size <= sizes.min) return last ? size : 0;
+
+        const auto p = data.data();
+        const auto end = std::min(size, sizes.max);
+        const auto middle = std::max(sizes.min, std::min(end, normal));
+
+        auto fp = uint64_t{ 0 };
+        auto i = sizes.min;
+        for (; i < middle; i++) {
+            fp = (fp << 1) + gear.value[p[i]];
+            if (!(fp & mask_s)) return i + 1;
+        }
+        for (; i < end; i++) {
+            fp = (fp << 1) + gear.value[p[i]];
+            if (!(fp & mask_l)) return i + 1;
+        }
+
+        if (end == sizes.max) return end;
+        return last ? size : 0;
+    };
+}
+
+chunker_t multiformats::rabin_chunker(chunk_sizes sizes)
+{
+    check_sizes(sizes);
+    static const rabin_tables tables;
+
+    const auto mask = (uint64_t{ 1 } << log2_floor(sizes.avg)) - 1;
+
+    return [sizes, mask](bufferview_t data, bool last) -> size_t {
+        const auto size = static_cast<size_t>(data.size());
+        if (size <= sizes.min) return last ? size : 0;
+
+        const auto p = data.data();
+        const auto end = std::min(size, sizes.max);
+
+        // only the last window bytes before min matter to the first boundary
+        const auto start = sizes.min > rabin_tables::window ? sizes.min - rabin_tables::window : 0;
+        auto fp = uint64_t{ 0 };
+        for (auto i = start; i < end; i++) {
+            if (i >= start + rabin_tables::window) fp ^= tables.out_table[p[i - rabin_tables::window]];
+            fp = tables.append(fp, p[i]);
+            if (i >= sizes.min && (fp & mask) == 0) return i + 1;
+        }
+
+        if (end == sizes.max) return end;
+        return last ? size : 0;
+    };
+}
+
+
+void multiformats::compute_chunks(hash_t hash, bufferview_t content, const chunker_t& chunker, const chunk_callback& on_chunk, thread_pool& pool)
+{
+    const auto type = details::hashcode_type<>{ hash };
+    const auto len = static_cast<size_t>(type.len());
+    const auto total = static_cast<size_t>(content.size());
+    const auto batch_size = 2 * batch_task_size * (pool.size() + 1);
+
+    // ends of the chunks of the batch starting at first
+    auto find_batch = [&](size_t first, std::vector<size_t>& ends) {
+        ends.clear();
+        for (auto pos = first; pos < total && pos - first < batch_size; ) {
+            auto rest = content.subspan(pos);
+            auto size = chunker(rest, true);
+            Expects(size > 0 && size <= static_cast<size_t>(rest.size()));
+            pos += size;
+            ends.push_back(pos);
+        }
+    };
+
+    auto current = std::vector<size_t>{};
+    auto next = std::vector<size_t>{};
+    auto digests = buffer_t{};
+    auto tasks = std::vector<size_t>{};
+
+    auto first = size_t{ 0 };
+    find_batch(first, current);
+    while (!current.empty()) {
+        const auto count = current.size();
+        auto start = [&](size_t i) { return i ? current[i - 1] : first; };
+
+        // group the chunks in hashing tasks: tasks[t] is the index of the first chunk of task t
+        tasks.assign(1, 0);
+        for (size_t i = 0, bytes = 0; i < count; i++) {
+            bytes += current[i] - start(i);
+            if (bytes >= batch_task_size && i + 1 < count) {
+                tasks.push_back(i + 1);
+                bytes = 0;
+            }
+        }
+        tasks.push_back(count);
+
+        // task 0 searches the boundaries of the next batch while the others hash this one
+        digests.resize(count * len);
+        pool.parallel_for(tasks.size(), [&](size_t t) {
+            if (t == 0) {
+                find_batch(current.back(), next);
+                return;
+            }
+            auto h = hasher{ hash };
+            for (auto i = tasks[t - 1]; i < tasks[t]; i++) {
+                h.update(content.subspan(start(i), current[i] - start(i)));
+                h.final(digests.data() + i * len);
+            }
+        });
+
+        for (size_t i = 0; i < count; i++) {
+            auto digest = bufferview_t{ digests.data() + i * len, static_cast<ptrdiff_t>(len) };
+            on_chunk({ start(i), current[i] - start(i), multihash{ hash, type.code(), digest, details::verified } });
+        }
+
+        first = current.back();
+        std::swap(current, next);
+    }
+
+    // an empty content is a single empty chunk
+    if (total == 0) on_chunk({ 0, 0, compute_multihash(hash, content) });
+}
+
+std::vector<chunk> multiformats::compute_chunks(hash_t hash, bufferview_t content, const chunker_t& chunker, thread_pool& pool)
+{
+    auto chunks = std::vector<chunk>{};
+    compute_chunks(hash, content, chunker, [&](const chunk& c) { chunks.push_back(c); }, pool);
+    return chunks;
+}
@@ -0,0 +1,133 @@
+#include "multiformats/merkle.h"
+
+using namespace multiformats;
+
+
+merkle_builder::merkle_builder(hash_t hash, chunker_t chunker, size_t fanout, callback_t on_node, thread_pool& pool)
+    : _hash(hash), _chunker(std::move(chunker)), _fanout(fanout), _on_node(std::move(on_node)), _pool(pool)
+    , _batch_size(2 * batch_task_size * (pool.size() + 1))
+{
+    Expects(details::hashcode_type<>{ hash }.len() > 0);
+    Expects(_chunker);
+    Expects(_fanout >= 2);
+}
+
+void merkle_builder::update(bufferview_t data)
+{
+    // append by slices of a batch so that a large update does not grow the buffer
+    while (!data.empty()) {
+        auto room = _pending.size() < _batch_size ? _batch_size - _pending.size() : _batch_size;
+        auto slice = data.first(std::min(static_cast<ptrdiff_t>(room), data.size()));
+        _pending.insert(_pending.end(), slice.begin(), slice.end());
+        data = data.subspan(slice.size());
+
+        if (_pending.size() >= _batch_size) process(false);
+    }
+}
+
+multihash merkle_builder::final()
+{
+    // the chunker must cut all the remaining content when it is the last
+    process(true);
+    Expects(_pending.empty());
+
+    // an empty content is a single empty chunk
+    if (_levels.empty()) {
+        auto leaf = compute_multihash(_hash, {});
+        if (_on_node) _on_node({ leaf, 0, 0, 0, {} });
+        push(0, std::move(leaf), 0);
+    }
+
+    // build the parents of the incomplete levels; a single node is promoted as is
+    for (size_t level = 0; level + 1 < _levels.size() || _levels[level].nodes.size() > 1; level++) {
+        auto& nodes = _levels[level].nodes;
+        if (nodes.size() == 1) {
+            auto size = _levels[level].size;
+            auto node = std::move(nodes.back());
+            nodes.clear();
+            _levels[level].offset += size;
+            _levels[level].size = 0;
+            push(level + 1, std::move(node), size);
+        }
+        else if (nodes.size() > 1) reduce(level);
+    }
+
+    auto root = std::move(_levels.back().nodes.back());
+    _levels.clear();
+    _pending.clear();
+    _offset = 0;
+    return root;
+}
+
+// Hash the complete chunks of the pending content in parallel
+void merkle_builder::process(bool last)
+{
+    auto data = bufferview_t{ _pending };
+    auto boundaries = std::vector<size_t>{};
+
+    auto first = size_t{ 0 };
+    for (;;) {
+        auto rest = data.subspan(first);
+        if (rest.empty()) break;
+        auto size = _chunker(rest, last);
+        if (size == 0) break;
+        Expects(size <= static_cast<size_t>(rest.size()));
+        first += size;
+        boundaries.push_back(first);
+    }
+    if (boundaries.empty()) return;
+
+    auto leaves = compute_multihashes(_hash, data.first(first), boundaries, _pool);
+
+    auto start = size_t{ 0 };
+    for (size_t i = 0; i < leaves.size(); i++) {
+        auto size = boundaries[i] - start;
+        if (_on_node) _on_node({ leaves[i], 0, _offset + start, size, {} });
+        push(0, std::move(leaves[i]), size);
+        start = boundaries[i];
+    }
+
+    _offset += first;
+    _pending.erase(_pending.begin(), _pending.begin() + first);
+}
+
+void merkle_builder::push(size_t level, multihash&& node, uint64_t size)
+{
+    if (_levels.size() <= level) {
+        _levels.resize(level + 1);
+        _levels[level].offset = level ? _levels[level - 1].offset - size : _offset;
+        _levels[level].nodes.reserve(_fanout);
+    }
+
+    _levels[level].nodes.push_back(std::move(node));
+    _levels[level].size += size;
+    if (_levels[level].nodes.size() == _fanout) reduce(level);
+}
+
+// Replace the nodes of a level by their parent in the next level
+void merkle_builder::reduce(size_t level)
+{
+    auto& current = _levels[level];
+
+    auto h = hasher{ _hash };
+    for (auto& child : current.nodes) h.update(child.data());
+    byte_t digest[max_digest_size];
+    h.final(digest);
+
+    auto parent = multihash{ _hash, h.code(), bufferview_t{ digest, static_cast<ptrdiff_t>(h.size()) }, details::verified };
+    if (_on_node) _on_node({ parent, static_cast<int>(level + 1), current.offset, current.size, current.nodes });
+
+    auto size = current.size;
+    current.nodes.clear();
+    current.offset += size;
+    current.size = 0;
+    push(level + 1, std::move(parent), size);
+}
+
+
+multihash multiformats::compute_merkle_root(hash_t hash, bufferview_t content, chunker_t chunker, size_t fanout, thread_pool& pool)
+{
+    auto builder = merkle_builder{ hash, std::move(chunker), fanout, {}, pool };
+    builder.update(content);
+    return builder.final();
+}
@@ -1,254 +1,788 @@
 #include <multiformats/multiaddr.h>
 #include <multiformats/multihash.h>
 
-#include <sstream>
+#include <map>
 
 using namespace multiformats;
 
-stringview_t multiformats::details::serialize_ipv4(stringview_t src, buffer_t& dst)
-{
-    auto first = std::begin(src);
-    auto end = std::end(src);
-    auto last = first + 1;
-    for (int i = 0; i < 4; i++)
+
+namespace {
+
+    bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+    int hex_digit(char c)
+    {
+        if (is_digit(c)) return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        return (c >= 'A' && c <= 'F') ? c - 'A' + 10 : -1;
+    }
+
+    int base32_digit(char c)
+    {
+        if (c >= 'a' && c <= 'z') return c - 'a';
+        if (c >= 'A' && c <= 'Z') return c - 'A';
+        return (c >= '2' && c <= '7') ? c - '2' + 26 : -1;
+    }
+
+    // Parse up to max_digits decimal digits, and return the end of the number (first if there is none)
+    const char* parse_decimal(const char* first, const char* last, int max_digits, uint32_t& value)
+    {
+        value = 0;
+        auto p = first;
+        for (; p != last && p - first < max_digits && is_digit(*p); p++) value = value * 10 + (*p - '0');
+        return p;
+    }
+
+    // Write the decimal form of value to dst, unless dst is null, and return its length
+    size_t format_decimal(uint32_t value, char* dst)
     {
-        last = std::find_if(first, end, [](char c) { return c != 'x' && (c < '0' || c > '9'); });
+        char digits[10];
+        auto n = 0;
+        do {
+            digits[n++] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        } while (value);
+
+        if (dst) for (auto i = 0; i < n; i++) dst[i] = digits[n - 1 - i];
+        return n;
+    }
 
-        auto value = std::stoi(std::string{ first, last }, 0, 0);
-        if (value < 0 || value > 0xFF) throw std::invalid_argument("Invalid IP4 address");
+    // Append a character to dst, unless dst is null
+    void put(char* dst, size_t& length, char c)
+    {
+        if (dst) dst[length] = c;
+        length++;
+    }
 
-        dst.push_back(gsl::narrow<byte_t>(value));
+    // Decode the base58btc digits up to the next '/' into out, whose size is returned in size (0 if it does not fit)
+    //    Returns the end of the digits, and the first invalid digit in invalid (or the end).
+    const char* decode_base58btc(const char* first, const char* last, byte_t* out, size_t capacity, size_t& size, const char*& invalid)
+    {
+        static const struct digit_table {
+            int8_t value[128];
+            digit_table() {
+                std::fill(std::begin(value), std::end(value), int8_t{ -1 });
+                auto digits = details::_BaseTable[details::find_baseimpl(base58btc)].digits;
+                for (auto i = 0; digits[i]; i++) value[static_cast<uint8_t>(digits[i])] = static_cast<int8_t>(i);
+            }
+        } table;
+
+        auto end = std::find(first, last, '/');
+        invalid = end;
+        size = 0;
+
+        // big-endian accumulation at the end of out, leading zero digits are leading zero bytes
+        auto p = first;
+        for (; p != end && *p == '1'; p++) { }
+        auto zeros = static_cast<size_t>(p - first);
+        if (zeros > capacity) return end;
+        auto digits = size_t{ 0 };
+        auto fits = true;
+        for (; p != end; p++) {
+            auto d = (*p & 0x80) ? -1 : table.value[static_cast<uint8_t>(*p)];
+            if (d < 0) { invalid = p; return end; }
+
+            auto carry = static_cast<uint32_t>(d);
+            for (size_t j = 0; j < digits; j++) {
+                carry += 58 * out[capacity - 1 - j];
+                out[capacity - 1 - j] = static_cast<byte_t>(carry);
+                carry >>= 8;
+            }
+            for (; carry; carry >>= 8) {
+                if (digits + zeros >= capacity) { fits = false; break; }
+                out[capacity - 1 - digits++] = static_cast<byte_t>(carry);
+            }
+        }
+        if (!fits) return end;
+
+        std::memmove(out + zeros, out + capacity - digits, digits);
+        std::fill(out, out + zeros, byte_t{ 0 });
+        size = zeros + digits;
+        return end;
+    }
+}
 
-        if (i < 3) {
-            if (*last != '.') throw std::invalid_argument("Invalid IP4 address");
-            first = last + 1;
+multiaddr_parse_result multiformats::parse_multiaddr(stringview_t src, gsl::span<byte_t> dst)
+{
+    auto out = details::addr_writer{ dst.data(), static_cast<size_t>(dst.size()) };
+    const auto begin = src.data();
+    const auto end = src.data() + src.size();
+    auto fail = [&](const char* at, const char* error) { return multiaddr_parse_result{ 0, error, static_cast<size_t>(at - begin) }; };
+
+    for (auto p = begin; p != end; ) {
+        // extract separator
+        if (*p != '/') return fail(p, "a protocol must follow a '/'");
+
+        // a trailing / is valid
+        if (++p == end) break;
+
+        // extract protocol name
+        auto name = p;
+        p = std::find(p, end, '/');
+        auto index = details::find_addrimpl_by_name({ name, p - name });
+        if (index == 0) return fail(name, "unsupported protocol");
+
+        const auto& impl = details::_AddrTable[index];
+        out.put_uvarint(impl.code);
+        if (impl.len != 0) {
+            // extract separator
+            if (p == end || p + 1 == end) return fail(p, "a value must follow a '/'");
+            p++;
+
+            // serialize
+            auto error = static_cast<const char*>(nullptr);
+            p = impl.serialize(p, end, out, error);
+            if (error) return fail(p, error);
+            if (p != end && *p != '/') return fail(p, "unexpected character");
         }
+        if (out.overflow) return fail(name, "the binary form does not fit in the output");
     }
 
-    return src.last(end-last);
+    return { out.size(), nullptr, 0 };
 }
-bufferview_t multiformats::details::deserialize_ipv4(bufferview_t src, std::string& dst)
+
+const char* multiformats::details::serialize_ipv4(const char* first, const char* last, addr_writer& dst, const char*& error)
 {
-    if (src.size() < 4)  throw std::invalid_argument("Invalid IP4 address");
-    
-    std::ostringstream oss;
-    oss << uint32_t{ src[0] } << '.' << uint32_t{ src[1] } << '.' << uint32_t{ src[2] } << '.' << uint32_t{ src[3] };
-    dst += oss.str();
+    auto p = first;
+    for (int i = 0; i < 4; i++)
+    {
+        if (i > 0) {
+            if (p == last || *p != '.') { error = "invalid IP4 address: expected '.'"; return p; }
+            p++;
+        }
 
-    return src.last(src.size() - 4);
+        auto value = uint32_t{};
+        auto end = parse_decimal(p, last, 3, value);
+        if (end == p) { error = "invalid IP4 address: expected a decimal byte"; return p; }
+        if (value > 0xFF) { error = "invalid IP4 address: out-of-range byte"; return p; }
+
+        dst.put(static_cast<byte_t>(value));
+        p = end;
+    }
+    return p;
+}
+size_t multiformats::details::deserialize_ipv4(bufferview_t value, char* dst)
+{
+    if (value.size() < 4)  throw std::invalid_argument("Invalid IP4 address");
+
+    auto length = size_t{ 0 };
+    for (auto i = 0; i < 4; i++) {
+        if (i > 0) put(dst, length, '.');
+        length += format_decimal(value[i], dst ? dst + length : nullptr);
+    }
+    return length;
 }
-bufferview_t multiformats::details::read_ipv4(bufferview_t src, buffer_t& dst)
+bufferview_t multiformats::details::read_ipv4(bufferview_t src, bufferview_t& value)
 {
     if (src.size() < 4)  throw std::invalid_argument("Invalid IP4 address");
     
-    auto first = src.first(4);
-    dst.insert(dst.end(), first.begin(), first.end());
-    
+    value = src.first(4);
     return src.last(src.size() - 4);
 }
 
 
-stringview_t multiformats::details::serialize_ipv6(stringview_t src, buffer_t& dst)
+const char* multiformats::details::serialize_ipv6(const char* first, const char* last, addr_writer& dst, const char*& error)
 {
-    auto elems = std::vector<stringview_t>{};
-
-    auto pos = to_string(src).find_first_not_of("0123456789abcdefABCDEF:");
+    byte_t bytes[16];
+    auto size = 0;      // number of bytes parsed
+    auto gap = -1;      // position of the "::" in bytes
+    auto p = first;
+
+    if (p != last && *p == ':') {
+        if (last - p < 2 || p[1] != ':') { error = "invalid IP6 address: expected '::'"; return p; }
+        gap = 0;
+        p += 2;
+    }
 
-    auto begin = src.begin();
-    auto end = (pos == std::string::npos) ? src.end() : begin + pos;
-    auto first = begin;
-    auto last = first;
+    while (p != last && *p != '/') {
+        if (size == 16) { error = "invalid IP6 address: too many groups"; return p; }
+
+        auto group = p;
+        auto value = uint32_t{ 0 };
+        for (; p != last && p - group < 4 && hex_digit(*p) >= 0; p++) value = value * 16 + hex_digit(*p);
+        if (p == group) { error = "invalid IP6 address: expected a hexadecimal group"; return p; }
+
+        // an IP4 address may stand for the last two groups
+        if (p != last && *p == '.') {
+            if (size > 12) { error = "invalid IP6 address: too many groups"; return group; }
+            auto ip4 = addr_writer{ bytes + size, 4 };
+            p = serialize_ipv4(group, last, ip4, error);
+            if (error) return p;
+            size += 4;
+            break;
+        }
 
-    while (last != end && elems.size() < 8) {
-        last = std::find(first, end, ':');
-        if (last - first > 4) throw std::invalid_argument("Invalid IP6 address: wrong size of element");
+        bytes[size++] = static_cast<byte_t>(value >> 8);
+        bytes[size++] = static_cast<byte_t>(value & 0xFF);
 
-        elems.push_back(src.subspan(first - begin, last - first));
+        if (p == last || *p == '/') break;
+        if (*p != ':') { error = "invalid IP6 address: expected ':'"; return p; }
+        p++;
 
-        if (last != end) first = last + 1;
+        if (p != last && *p == ':') {
+            if (gap >= 0) { error = "invalid IP6 address: more than one '::'"; return p - 1; }
+            gap = size;
+            p++;
+        }
+        else if (p == last || *p == '/') { error = "invalid IP6 address: expected a hexadecimal group"; return p; }
     }
 
-    auto zeros = 8 - elems.size();
-    for (auto item : elems)
-        if (item.empty())
-            zeros++;
-
-    auto elemview = gsl::span<stringview_t>(elems);
-    if (elemview[0].empty()) elemview = elemview.last(elemview.size() - 1);
-    if (elemview[elemview.size() - 1].empty()) elemview = elemview.first(elemview.size() - 1);
+    if (gap < 0 && size != 16) { error = "invalid IP6 address: too few groups"; return p; }
+    if (gap >= 0 && size == 16) { error = "invalid IP6 address: '::' must stand for at least one group"; return p; }
 
-    for (auto item : elemview) {
-        if (item.empty()) {
-            dst.insert(dst.end(), 2 * zeros, 0);
+    // expand the "::"
+    auto head = gap < 0 ? size : gap;
+    dst.put({ bytes, head });
+    for (auto i = size; i < 16; i++) dst.put(0);
+    dst.put({ bytes + head, size - head });
+    return p;
+}
+size_t multiformats::details::deserialize_ipv6(bufferview_t value, char* dst)
+{
+    if (value.size() < 16)  throw std::invalid_argument("Invalid IP6 address");
+
+    uint32_t groups[8];
+    for (auto i = 0; i < 8; i++) groups[i] = (uint32_t{ value[2 * i] } << 8) | value[2 * i + 1];
+
+    // the longest run of at least two zero groups (the first one on a tie) is written "::" (RFC 5952)
+    auto gap = -1;
+    auto gap_size = 1;
+    for (auto i = 0; i < 8; ) {
+        auto j = i;
+        while (j < 8 && groups[j] == 0) j++;
+        if (j - i > gap_size) {
+            gap = i;
+            gap_size = j - i;
         }
-        else {
-            auto value = std::stoi(gsl::to_string(item), nullptr, 16);
+        i = (j == i) ? i + 1 : j;
+    }
 
-            dst.push_back(gsl::narrow<byte_t>(value >> 8));
-            dst.push_back(gsl::narrow<byte_t>(value & 0xFF));
+    auto length = size_t{ 0 };
+    for (auto i = 0; i < 8; i++) {
+        if (i == gap) {
+            put(dst, length, ':');
+            put(dst, length, ':');
+            i += gap_size - 1;
+            continue;
         }
-    }
+        if (i > 0 && i != gap + gap_size) put(dst, length, ':');
 
-    return src.last(src.end() - last);
-}
-bufferview_t multiformats::details::deserialize_ipv6(bufferview_t src, string_t& dst)
-{
-    dst += encode(base58btc, src).str();
-    return {};
+        // lowercase hexadecimal without leading zeros
+        auto shift = 12;
+        while (shift > 0 && (groups[i] >> shift) == 0) shift -= 4;
+        for (; shift >= 0; shift -= 4) put(dst, length, "0123456789abcdef"[(groups[i] >> shift) & 0xF]);
+    }
+    return length;
 }
-bufferview_t multiformats::details::read_ipv6(bufferview_t src, buffer_t& dst)
+bufferview_t multiformats::details::read_ipv6(bufferview_t src, bufferview_t& value)
 {
-    dst += src;
-    return {};
+    if (src.size() < 16)  throw std::invalid_argument("Invalid IP6 address");
+
+    value = src.first(16);
+    return src.last(src.size() - 16);
 }
 
 
-stringview_t multiformats::details::serialize_ipfs(stringview_t src, buffer_t& dst)
+const char* multiformats::details::serialize_ipfs(const char* first, const char* last, addr_writer& dst, const char*& error)
 {
-    auto buffer = buffer_t{};
-    auto view = decode(base58btc, src, buffer);
-    if (multihash{ buffer }.hash() != sha2_256) throw std::invalid_argument("Invalid IPFS address : wrong hash");
-    dst += buffer;
-    return view;
+    // the value is a base58btc sha2-256 multihash
+    const auto type = details::hashcode_type<sha2_256>{ sha2_256 };
+
+    byte_t prefix[2 * uvarint::max_varint_size];
+    auto prefix_end = uvarint::encode(type.len(), uvarint::encode(type.code(), prefix));
+    const auto expected = static_cast<size_t>(prefix_end - prefix) + type.len();
+
+    byte_t mh[64];
+    auto size = size_t{};
+    auto invalid = static_cast<const char*>(nullptr);
+    auto end = decode_base58btc(first, last, mh, sizeof(mh), size, invalid);
+    if (invalid != end) { error = "invalid IPFS address: invalid base58btc digit"; return invalid; }
+    if (size != expected || !std::equal(prefix, prefix_end, mh)) { error = "invalid IPFS address: not a sha2-256 multihash"; return first; }
+
+    dst.put({ mh, static_cast<ptrdiff_t>(size) });
+    return end;
 }
-bufferview_t multiformats::details::deserialize_ipfs(bufferview_t src, string_t& dst)
+size_t multiformats::details::deserialize_ipfs(bufferview_t value, char* dst)
 {
-    dst += encode(base58btc, src).str();
-    return {};
+    if (value.empty()) throw std::invalid_argument("Invalid IPFS address");
+
+    // base58btc, computed with little-endian limbs of 5 digits (58^5 < 2^32) and 3 bytes of input at a time;
+    // a multihash of up to 128 bytes is converted on the stack
+    constexpr auto limb_base = uint64_t{ 58 * 58 * 58 * 58 * 58 };
+    const auto alphabet = details::_BaseTable[details::find_baseimpl(base58btc)].digits;
+    const auto size = static_cast<size_t>(value.size());
+    const auto capacity = size * 138 / 500 + 2;
+    uint32_t local[40];
+    auto heap = std::vector<uint32_t>{};
+    auto limbs = local;
+    if (capacity > _countof(local)) {
+        heap.resize(capacity);
+        limbs = heap.data();
+    }
+
+    auto zeros = size_t{ 0 };
+    while (zeros < size && value[zeros] == 0) zeros++;
+
+    auto count = size_t{ 0 };
+    for (auto i = zeros; i < size; ) {
+        auto bytes = (i == zeros && (size - zeros) % 3) ? (size - zeros) % 3 : 3;
+        auto carry = uint64_t{ 0 };
+        for (size_t k = 0; k < bytes; k++) carry = (carry << 8) | value[i++];
+        for (size_t j = 0; j < count; j++) {
+            carry += uint64_t{ limbs[j] } << (8 * bytes);
+            limbs[j] = static_cast<uint32_t>(carry % limb_base);
+            carry /= limb_base;
+        }
+        for (; carry; carry /= limb_base) limbs[count++] = static_cast<uint32_t>(carry % limb_base);
+    }
+
+    // the most significant limb has no leading zero digits
+    auto top = 0;
+    for (auto v = count ? limbs[count - 1] : 0u; v; v /= 58) top++;
+    const auto length = zeros + (count ? 5 * (count - 1) + top : 0);
+
+    if (dst) {
+        std::fill(dst, dst + zeros, alphabet[0]);
+        auto p = dst + length;
+        for (size_t j = 0; j < count; j++) {
+            auto v = limbs[j];
+            for (auto d = 0; d < (j + 1 < count ? 5 : top); d++, v /= 58) *--p = alphabet[v % 58];
+        }
+    }
+    return length;
 }
-bufferview_t multiformats::details::read_ipfs(bufferview_t src, buffer_t& dst)
+bufferview_t multiformats::details::read_ipfs(bufferview_t src, bufferview_t& value)
 {
-    dst += src;
-    return {};
+    // the value is a binary multihash: <varint code><varint length><digest>
+    // an empty value or a missing length would decode as an empty multihash
+    auto code = uint64_t{};
+    auto len = ptrdiff_t{};
+    auto rest = src.empty() ? src : uvarint::decode(src, &code);
+    if (rest.empty()) throw std::invalid_argument("Invalid IPFS address : not enough data");
+    auto digest = uvarint::decode(rest, &len);
+    if (len > digest.size()) throw std::invalid_argument("Invalid IPFS address : not enough data");
+
+    auto size = (digest.data() - src.data()) + len;
+    value = src.first(size);
+    return src.last(src.size() - size);
 }
 
 
-stringview_t multiformats::details::serialize_onion(stringview_t src, buffer_t& dst)
+const char* multiformats::details::serialize_onion(const char* first, const char* last, addr_writer& dst, const char*& error)
 {
-    auto last = std::find(src.begin(), src.end(), '/');
-
-    auto view = src.first(last - src.begin());
-
-    auto parts = split(src, ':');
-    if (parts.size() != 2) throw std::invalid_argument("Invalid onion address : must <address>:<port>");
-
-    // onion address without the ".onion" substring
-    if (parts[0].size() != 16) throw std::invalid_argument("Invalid onion address : wrong address size");
-
-    // onion port number
-    auto port = std::stoi(gsl::to_string(parts[1]), nullptr, 0);
-    if (port < 1 || port > 0xFFFF) throw std::invalid_argument("Invalid onion address : out-of-range port");
-
-    dst += decode(base32, parts[0]);
-    dst += gsl::narrow<byte_t>(port >> 8);
-    dst += gsl::narrow<byte_t>(port & 0xFF);
-
-    return src.last(src.end() - last);
+    // <16 base32 characters of the address without ".onion">:<port>
+    auto bits = uint32_t{ 0 };
+    auto count = 0;
+    auto p = first;
+    for (; p != last && *p != ':' && *p != '/'; p++) {
+        auto d = base32_digit(*p);
+        if (d < 0) { error = "invalid onion address: invalid base32 character"; return p; }
+        if (p - first == 16) { error = "invalid onion address: wrong address size"; return p; }
+
+        bits = (bits << 5) | static_cast<uint32_t>(d);
+        count += 5;
+        if (count >= 8) {
+            count -= 8;
+            dst.put(static_cast<byte_t>(bits >> count));
+            bits &= (1u << count) - 1;
+        }
+    }
+    if (p - first != 16) { error = "invalid onion address: wrong address size"; return p; }
+    if (p == last || *p != ':') { error = "invalid onion address: must be <address>:<port>"; return p; }
+    p++;
+
+    auto port = uint32_t{};
+    auto end = parse_decimal(p, last, 5, port);
+    if (end == p) { error = "invalid onion address: expected a port number"; return p; }
+    if (port < 1 || port > 0xFFFF) { error = "invalid onion address: out-of-range port"; return p; }
+
+    dst.put(static_cast<byte_t>(port >> 8));
+    dst.put(static_cast<byte_t>(port & 0xFF));
+    return end;
 }
-bufferview_t multiformats::details::deserialize_onion(bufferview_t src, string_t& dst)
+size_t multiformats::details::deserialize_onion(bufferview_t value, char* dst)
 {
-    return src;
+    if (value.size() < 12)  throw std::invalid_argument("Invalid onion address");
+
+    // 10 bytes of address in base32, then the port
+    auto length = size_t{ 0 };
+    auto bits = uint32_t{ 0 };
+    auto count = 0;
+    for (auto i = 0; i < 10; i++) {
+        bits = (bits << 8) | value[i];
+        for (count += 8; count >= 5; count -= 5) put(dst, length, "abcdefghijklmnopqrstuvwxyz234567"[(bits >> (count - 5)) & 0x1F]);
+        bits &= (1u << count) - 1;
+    }
+    put(dst, length, ':');
+    return length + format_decimal((uint32_t{ value[10] } << 8) | value[11], dst ? dst + length : nullptr);
 }
-bufferview_t multiformats::details::read_onion(bufferview_t src, buffer_t& dst)
+bufferview_t multiformats::details::read_onion(bufferview_t src, bufferview_t& value)
 {
-    return src;
+    if (src.size() < 12)  throw std::invalid_argument("Invalid onion address");
+
+    value = src.first(12);
+    return src.last(src.size() - 12);
 }
 
 
-stringview_t serialize_lenstring(stringview_t src, buffer_t& dst)
+const char* serialize_lenstring(const char* first, const char* last, details::addr_writer& dst, const char*& error)
 {
-    dst += uvarint::encode(src.size());
-    dst += as_buffer(src);
+    if (first == last) { error = "empty value"; return first; }
 
-    return {};
+    dst.put_uvarint(static_cast<uint64_t>(last - first));
+    dst.put(as_buffer({ first, last - first }));
+    return last;
 }
-bufferview_t deserialize_lenstring(bufferview_t src, string_t& dst)
+size_t deserialize_lenstring(bufferview_t value, char* dst)
 {
     auto len = ptrdiff_t{};
-    src = uvarint::decode(src, &len);
+    auto src = uvarint::decode(value, &len);
     if (len > src.size()) throw std::invalid_argument("Invalid address : not enough data");
 
-    dst.append(src.begin(), src.begin() + len);
-
-    return src.last(src.size() - len);
+    if (dst) std::memcpy(dst, src.data(), static_cast<size_t>(len));
+    return static_cast<size_t>(len);
 }
-bufferview_t read_lenstring(bufferview_t src, buffer_t& dst)
+bufferview_t read_lenstring(bufferview_t src, bufferview_t& value)
 {
+    // the value keeps its varint length prefix
     auto len = ptrdiff_t{};
-    src = uvarint::decode(src, &len);
-    if (len > src.size()) throw std::invalid_argument("Invalid unix address : not enough data");
-
-    dst += uvarint::encode(src.size());
-    dst += src.first(len);
+    auto rest = uvarint::decode(src, &len);
+    if (len > rest.size()) throw std::invalid_argument("Invalid address : not enough data");
 
-    return src.last(src.size() - len);
+    auto size = (rest.data() - src.data()) + len;
+    value = src.first(size);
+    return src.last(src.size() - size);
 }
 
 
-stringview_t multiformats::details::serialize_unix(stringview_t src, buffer_t& dst)
+const char* multiformats::details::serialize_unix(const char* first, const char* last, addr_writer& dst, const char*& error)
 {
     // the address is the whole remaining string, prefixed by a varint len
-    return serialize_lenstring(src, dst);
+    return serialize_lenstring(first, last, dst, error);
 }
-bufferview_t multiformats::details::deserialize_unix(bufferview_t src, string_t& dst)
+size_t multiformats::details::deserialize_unix(bufferview_t value, char* dst)
 {
     // the address is a varint len prefixed string
-    return deserialize_lenstring(src, dst);
+    return deserialize_lenstring(value, dst);
 }
-bufferview_t multiformats::details::read_unix(bufferview_t src, buffer_t& dst)
+bufferview_t multiformats::details::read_unix(bufferview_t src, bufferview_t& value)
 {
-    return read_lenstring(src, dst);
+    return read_lenstring(src, value);
 }
 
 
-stringview_t multiformats::details::serialize_dns(stringview_t src, buffer_t& dst)
+const char* multiformats::details::serialize_dns(const char* first, const char* last, addr_writer& dst, const char*& error)
 {
-    auto last = std::find(src.begin(), src.end(), '/');
-    auto view = src.first(last - src.begin());
-
-    serialize_lenstring(src, dst);
-
-    return src.last(src.end() - last);
+    return serialize_lenstring(first, std::find(first, last, '/'), dst, error);
 }
-bufferview_t multiformats::details::deserialize_dns(bufferview_t src, string_t& dst)
+size_t multiformats::details::deserialize_dns(bufferview_t value, char* dst)
 {
-    return deserialize_lenstring(src, dst);
+    return deserialize_lenstring(value, dst);
 }
-bufferview_t multiformats::details::read_dns(bufferview_t src, buffer_t& dst)
+bufferview_t multiformats::details::read_dns(bufferview_t src, bufferview_t& value)
 {
-    return read_lenstring(src, dst);
+    return read_lenstring(src, value);
 }
 
 
-stringview_t multiformats::details::serialize_port(stringview_t src, buffer_t& dst)
+const char* multiformats::details::serialize_port(const char* first, const char* last, addr_writer& dst, const char*& error)
+{
+    auto value = uint32_t{};
+    auto end = parse_decimal(first, last, 5, value);
+    if (end == first) { error = "invalid port: expected a decimal number"; return first; }
+    if (value > 0xFFFF) { error = "invalid port: out of range"; return first; }
+
+    dst.put(static_cast<byte_t>(value >> 8));
+    dst.put(static_cast<byte_t>(value & 0xFF));
+    return end;
+}
+size_t multiformats::details::deserialize_port(bufferview_t value, char* dst)
 {
-    size_t index = 0;
-    auto value = std::stoi(gsl::to_string(src), &index, 0);
+    if (value.size() < 2)  throw std::invalid_argument("Invalid port");
 
-    if (value < 0 || value > 0xFFFF) throw std::invalid_argument("Invalid port");
-    
-    dst.push_back(gsl::narrow<byte_t>(value >> 8));
-    dst.push_back(gsl::narrow<byte_t>(value & 0xFF));
-    
-    return src.last(src.size() - index);
+    return format_decimal((uint32_t{ value[0] } << 8) | value[1], dst);
 }
-bufferview_t multiformats::details::deserialize_port(bufferview_t src, std::string& dst)
+bufferview_t multiformats::details::read_port(bufferview_t src, bufferview_t& value)
 {
     if (src.size() < 2)  throw std::invalid_argument("Invalid port");
 
-    uint16_t port = (uint16_t{ src[0] } << 8) + src[1];
-    std::ostringstream oss;
-    oss << port;
-    dst += oss.str();
-
+    value = src.first(2);
     return src.last(src.size() - 2);
 }
-bufferview_t multiformats::details::read_port(bufferview_t src, buffer_t& dst)
+
+
+namespace {
+
+    // Nondeterministic automaton built from a pattern (Thompson's construction)
+    struct addr_nfa
+    {
+        struct state
+        {
+            std::vector<int> epsilon;
+            int symbol = -1;        // protocol of the transition to target, if any
+            int target = -1;
+            uint32_t accept = 0;
+        };
+        std::vector<state> states;
+
+        int add() { states.emplace_back(); return static_cast<int>(states.size() - 1); }
+    };
+
+    // Recursive descent parser of a pattern into the automaton
+    //    alternatives := sequence ('|' sequence)*
+    //    sequence     := (item ('?' | '*' | '+')?)*
+    //    item         := name | '(' alternatives ')'
+    class pattern_parser
+    {
+    public:
+        struct fragment { int first, last; };
+
+        pattern_parser(stringview_t src, addr_nfa& nfa) : _first(src.data()), _p(src.data()), _end(src.data() + src.size()), _nfa(nfa)
+        { }
+
+        fragment parse()
+        {
+            auto f = alternatives();
+            skip();
+            if (_p != _end) fail(*_p == ')' ? "unbalanced parenthesis" : "unexpected character");
+            return f;
+        }
+
+    private:
+        static bool is_name(char c) { return (c >= 'a' && c <= 'z') || is_digit(c) || c == '-'; }
+
+        void skip() { while (_p != _end && (*_p == '/' || *_p == ' ')) _p++; }
+
+        [[noreturn]] void fail(const char* error) const
+        {
+            throw std::invalid_argument("Invalid multiaddr pattern: " + std::string{ error } + " at position " + std::to_string(_p - _first));
+        }
+
+        fragment alternatives()
+        {
+            auto f = sequence();
+            skip();
+            if (_p == _end || *_p != '|') return f;
+
+            auto alt = fragment{ _nfa.add(), _nfa.add() };
+            auto join = [&](fragment branch) {
+                _nfa.states[alt.first].epsilon.push_back(branch.first);
+                _nfa.states[branch.last].epsilon.push_back(alt.last);
+            };
+            join(f);
+            while (_p != _end && *_p == '|') {
+                _p++;
+                join(sequence());
+                skip();
+            }
+            return alt;
+        }
+
+        fragment sequence()
+        {
+            auto s = _nfa.add();
+            auto f = fragment{ s, s };
+            for (;;) {
+                skip();
+                if (_p == _end || *_p == '|' || *_p == ')') return f;
+
+                auto i = item();
+                _nfa.states[f.last].epsilon.push_back(i.first);
+                f.last = i.last;
+            }
+        }
+
+        fragment item()
+        {
+            auto f = fragment{};
+            if (*_p == '(') {
+                _p++;
+                f = alternatives();
+                if (_p == _end || *_p != ')') fail("unbalanced parenthesis");
+                _p++;
+            }
+            else {
+                auto name = _p;
+                while (_p != _end && is_name(*_p)) _p++;
+                if (_p == name) fail("expected a protocol name");
+
+                auto index = details::find_addrimpl_by_name({ name, _p - name });
+                if (index == 0) { _p = name; fail("unknown protocol"); }
+
+                f = { _nfa.add(), _nfa.add() };
+                _nfa.states[f.first].symbol = index;
+                _nfa.states[f.first].target = f.last;
+            }
+
+            if (_p == _end || (*_p != '?' && *_p != '*' && *_p != '+')) return f;
+
+            auto r = fragment{ _nfa.add(), _nfa.add() };
+            _nfa.states[r.first].epsilon.push_back(f.first);
+            _nfa.states[f.last].epsilon.push_back(r.last);
+            if (*_p != '+') _nfa.states[r.first].epsilon.push_back(r.last);
+            if (*_p != '?') _nfa.states[f.last].epsilon.push_back(f.first);
+            _p++;
+            return r;
+        }
+
+        const char* _first;
+        const char* _p;
+        const char* _end;
+        addr_nfa& _nfa;
+    };
+
+    // The states reachable by epsilon transitions from states of an automaton, reduced to those that matter to the
+    // subset construction (the states with a transition or accepting)
+    //    The closure of each state is computed once, as the subsets share most of their states.
+    class epsilon_closure
+    {
+    public:
+        explicit epsilon_closure(const addr_nfa& nfa) : _nfa(nfa), _closures(nfa.states.size()), _done(nfa.states.size()), _seen(nfa.states.size())
+        { }
+
+        // Replace a set of states by its closure, sorted
+        void operator()(std::vector<int>& set)
+        {
+            auto sources = std::move(set);
+            set.clear();
+            for (auto s : sources) {
+                for (auto t : of(s)) {
+                    if (!_seen[t]) { _seen[t] = true; set.push_back(t); }
+                }
+            }
+            for (auto t : set) _seen[t] = false;
+            std::sort(set.begin(), set.end());
+        }
+
+    private:
+        const std::vector<int>& of(int s)
+        {
+            if (_done[s]) return _closures[s];
+
+            auto reached = std::vector<int>{ s };
+            _seen[s] = true;
+            for (size_t i = 0; i < reached.size(); i++) {
+                for (auto t : _nfa.states[reached[i]].epsilon) {
+                    if (!_seen[t]) { _seen[t] = true; reached.push_back(t); }
+                }
+            }
+            for (auto t : reached) _seen[t] = false;
+
+            auto& closure = _closures[s];
+            for (auto t : reached)
+                if (_nfa.states[t].symbol >= 0 || _nfa.states[t].accept) closure.push_back(t);
+            _done[s] = true;
+            return closure;
+        }
+
+        const addr_nfa& _nfa;
+        std::vector<std::vector<int>> _closures;
+        std::vector<bool> _done;
+        std::vector<bool> _seen;
+    };
+}
+
+
+details::addr_dfa multiformats::details::compile_patterns(gsl::span<const stringview_t> patterns)
 {
-    if (src.size() < 2)  throw std::invalid_argument("Invalid port");
+    Expects(patterns.size() <= 32);
+
+    auto nfa = addr_nfa{};
+    auto start = nfa.add();
+    for (ptrdiff_t k = 0; k < patterns.size(); k++) {
+        auto f = pattern_parser{ patterns[k], nfa }.parse();
+        nfa.states[start].epsilon.push_back(f.first);
+        nfa.states[f.last].accept |= uint32_t{ 1 } << k;
+    }
 
-    auto first = src.first(2);
-    dst.insert(dst.end(), first.begin(), first.end());
+    // subset construction: each state of the automaton is a set of states of nfa
+    auto dfa = addr_dfa{};
+    auto closure = epsilon_closure{ nfa };
+    auto sets = std::vector<std::vector<int>>{ {}, { start } };
+    auto ids = std::map<std::vector<int>, size_t>{};
+    closure(sets[1]);
+    ids[sets[0]] = 0;
+    ids[sets[1]] = 1;
+
+    std::vector<int> targets[addr_dfa::symbols];
+    for (size_t id = 0; id < sets.size(); id++) {
+        dfa.next.resize(sets.size() * addr_dfa::symbols, 0);
+        dfa.accept.resize(sets.size(), 0);
+
+        for (auto s : sets[id]) {
+            dfa.accept[id] |= nfa.states[s].accept;
+            if (nfa.states[s].symbol >= 0) targets[nfa.states[s].symbol].push_back(nfa.states[s].target);
+        }
 
-    return src.last(src.size() - 2);
+        for (size_t symbol = 1; symbol < addr_dfa::symbols; symbol++) {
+            auto& target = targets[symbol];
+            if (target.empty()) continue;
+            closure(target);
+
+            auto it = ids.find(target);
+            if (it == ids.end()) {
+                if (sets.size() > 0xFFFF) throw std::invalid_argument("Invalid multiaddr pattern: too many states");
+                it = ids.emplace(target, sets.size()).first;
+                sets.push_back(target);
+            }
+            dfa.next[id * addr_dfa::symbols + symbol] = static_cast<uint16_t>(it->second);
+            target.clear();
+        }
+    }
+    dfa.next.resize(sets.size() * addr_dfa::symbols, 0);
+    dfa.accept.resize(sets.size(), 0);
+    return dfa;
+}
+
+const details::addr_patterns& multiformats::details::builtin_patterns()
+{
+    // the patterns of js-mafmt, composed as strings
+    static const addr_patterns patterns = [] {
+        auto group = [](std::initializer_list<std::string> alternatives) {
+            auto s = std::string{ "(" };
+            for (auto& a : alternatives) s += (s.size() > 1 ? "|" : "") + a;
+            return s + ")";
+        };
+
+        const auto dns_name = group({ "dnsaddr", "dns4", "dns6" });
+        const auto ip = group({ "ip4", "ip6" });
+        const auto tcp = ip + "/tcp";
+        const auto udp = ip + "/udp";
+        const auto utp = udp + "/utp";
+        const auto dns = dns_name + "(/tcp)?";
+        const auto websockets = group({ tcp, dns }) + "/ws";
+        const auto websocketssecure = group({ tcp, dns }) + "/wss";
+        // the combinators never reached DNS/http, as DNS alone matched its prefix first
+        const auto http = group({ tcp + "/http", dns });
+        const auto webrtcstar = group({ websockets, websocketssecure }) + "/p2p-webrtc-star/ipfs";
+        const auto websocketsstar = group({ websockets, websocketssecure }) + "/p2p-websocket-star(/ipfs)?";
+        const auto webrtcdirect = http + "/p2p-webrtc-direct";
+        // nor WebRTCStar and WebRTCDirect, whose websockets and http prefixes matched first
+        const auto reliable = group({ websockets, websocketssecure, http, tcp, utp });
+        const auto ipfs_only = group({ reliable + "/ipfs", webrtcstar, "ipfs" });
+        const auto circuit_hop = group({
+            ipfs_only + "/p2p-circuit/" + ipfs_only,
+            ipfs_only + "/p2p-circuit",
+            "p2p-circuit/" + ipfs_only,
+            reliable + "/p2p-circuit",
+            "p2p-circuit/" + reliable,
+            "p2p-circuit" });
+        const auto circuit = circuit_hop + "+";
+        // Circuit _IPFS Circuit | _IPFS Circuit | Circuit _IPFS | Circuit | _IPFS, factored
+        const auto ipfs = group({ circuit_hop + "*" + ipfs_only + circuit_hop + "*", circuit });
+
+        // in the order of the members of addr_patterns, which is the order of the bits of addr_class
+        const std::string sources[] = { "dns4", "dns6", dns, ip, tcp, udp, utp, http, websockets, websocketssecure,
+            websocketsstar, webrtcstar, webrtcdirect, reliable, circuit, ipfs };
+        auto views = std::vector<stringview_t>{};
+        for (auto& s : sources) views.emplace_back(s.data(), static_cast<ptrdiff_t>(s.size()));
+
+        auto compile = [&](size_t k) { return multiaddr_pattern{ views[k] }; };
+        return addr_patterns{
+            compile(0), compile(1), compile(2), compile(3), compile(4), compile(5), compile(6), compile(7),
+            compile(8), compile(9), compile(10), compile(11), compile(12), compile(13), compile(14), compile(15),
+            compile_patterns(views)
+        };
+    }();
+    return patterns;
 }
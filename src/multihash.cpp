@@ -0,0 +1,225 @@
+#include "multiformats/multihash.h"
+
+using namespace multiformats;
+
+
+namespace {
+
+    // State shared by the Merkle-Damgard hash functions with 512-bit blocks (sha1, sha2_256)
+    struct md32_state {
+        uint32_t h[8];
+        uint64_t length;
+        byte_t   block[64];
+    };
+    static_assert(sizeof(md32_state) <= sizeof(details::hash_context), "hash_context is too small");
+
+    typedef void(*Compress)(uint32_t* h, const byte_t* block);
+
+    md32_state& as_md32(details::hash_context& ctx) { return *reinterpret_cast<md32_state*>(&ctx); }
+
+    inline uint32_t rotl(uint32_t x, int n) { return (x << n) | (x >> (32 - n)); }
+    inline uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+    inline uint32_t load_be32(const byte_t* p)
+    {
+        return (uint32_t{ p[0] } << 24) | (uint32_t{ p[1] } << 16) | (uint32_t{ p[2] } << 8) | uint32_t{ p[3] };
+    }
+    inline void store_be32(byte_t* p, uint32_t v)
+    {
+        p[0] = static_cast<byte_t>(v >> 24);
+        p[1] = static_cast<byte_t>(v >> 16);
+        p[2] = static_cast<byte_t>(v >> 8);
+        p[3] = static_cast<byte_t>(v);
+    }
+
+    void md32_update(md32_state& st, bufferview_t data, Compress compress)
+    {
+        auto first = data.data();
+        auto size = static_cast<size_t>(data.size());
+        if (size == 0) return;
+
+        auto used = static_cast<size_t>(st.length % 64);
+        st.length += size;
+
+        // complete a pending block
+        if (used) {
+            auto n = std::min(size, 64 - used);
+            std::memcpy(st.block + used, first, n);
+            first += n;
+            size -= n;
+            if (used + n < 64) return;
+            compress(st.h, st.block);
+        }
+
+        // process full blocks in place
+        for (; size >= 64; first += 64, size -= 64)
+            compress(st.h, first);
+
+        if (size) std::memcpy(st.block, first, size);
+    }
+
+    void md32_final(md32_state& st, Compress compress)
+    {
+        auto used = static_cast<size_t>(st.length % 64);
+        const auto bits = st.length * 8;
+
+        st.block[used++] = 0x80;
+        if (used > 56) {
+            std::memset(st.block + used, 0, 64 - used);
+            compress(st.h, st.block);
+            used = 0;
+        }
+        std::memset(st.block + used, 0, 56 - used);
+        for (auto i = 0; i < 8; i++)
+            st.block[56 + i] = static_cast<byte_t>(bits >> (56 - 8 * i));
+        compress(st.h, st.block);
+    }
+
+
+    void sha1_compress(uint32_t* h, const byte_t* block)
+    {
+        uint32_t w[80];
+        for (auto i = 0; i < 16; i++) w[i] = load_be32(block + 4 * i);
+        for (auto i = 16; i < 80; i++) w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+        auto a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (auto i = 0; i < 80; i++) {
+            uint32_t f, k;
+            if (i < 20)      { f = (b & c) | (~b & d);          k = 0x5A827999; }
+            else if (i < 40) { f = b ^ c ^ d;                   k = 0x6ED9EBA1; }
+            else if (i < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8F1BBCDC; }
+            else             { f = b ^ c ^ d;                   k = 0xCA62C1D6; }
+
+            auto t = rotl(a, 5) + f + e + k + w[i];
+            e = d; d = c; c = rotl(b, 30); b = a; a = t;
+        }
+
+        h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+    }
+
+
+    const uint32_t _Sha256K[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+    };
+
+    void sha2_256_compress(uint32_t* h, const byte_t* block)
+    {
+        uint32_t w[64];
+        for (auto i = 0; i < 16; i++) w[i] = load_be32(block + 4 * i);
+        for (auto i = 16; i < 64; i++) {
+            auto s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            auto s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        auto a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], hh = h[7];
+        for (auto i = 0; i < 64; i++) {
+            auto S1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+            auto ch = (e & f) ^ (~e & g);
+            auto t1 = hh + S1 + ch + _Sha256K[i] + w[i];
+            auto S0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+            auto maj = (a & b) ^ (a & c) ^ (b & c);
+            auto t2 = S0 + maj;
+
+            hh = g; g = f; f = e; e = d + t1; d = c; c = b; b = a; a = t1 + t2;
+        }
+
+        h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e; h[5] += f; h[6] += g; h[7] += hh;
+    }
+}
+
+
+void multiformats::details::sha1_init(hash_context& ctx)
+{
+    auto& st = as_md32(ctx);
+    const uint32_t iv[] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+    std::copy(std::begin(iv), std::end(iv), st.h);
+    st.length = 0;
+}
+void multiformats::details::sha1_update(hash_context& ctx, bufferview_t data)
+{
+    md32_update(as_md32(ctx), data, sha1_compress);
+}
+void multiformats::details::sha1_final(hash_context& ctx, byte_t* digest)
+{
+    auto& st = as_md32(ctx);
+    md32_final(st, sha1_compress);
+    for (auto i = 0; i < 5; i++) store_be32(digest + 4 * i, st.h[i]);
+}
+
+
+void multiformats::details::sha2_256_init(hash_context& ctx)
+{
+    auto& st = as_md32(ctx);
+    const uint32_t iv[] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+    std::copy(std::begin(iv), std::end(iv), st.h);
+    st.length = 0;
+}
+void multiformats::details::sha2_256_update(hash_context& ctx, bufferview_t data)
+{
+    md32_update(as_md32(ctx), data, sha2_256_compress);
+}
+void multiformats::details::sha2_256_final(hash_context& ctx, byte_t* digest)
+{
+    auto& st = as_md32(ctx);
+    md32_final(st, sha2_256_compress);
+    for (auto i = 0; i < 8; i++) store_be32(digest + 4 * i, st.h[i]);
+}
+
+
+std::vector<multihash> multiformats::compute_multihashes(hash_t hash, gsl::span<const bufferview_t> inputs, thread_pool& pool)
+{
+    const auto type = details::hashcode_type<>{ hash };
+    const auto count = static_cast<size_t>(inputs.size());
+    const auto len = static_cast<size_t>(type.len());
+
+    // split the inputs in tasks: tasks[t] is the index of the first input of task t
+    auto tasks = std::vector<size_t>{ 0 };
+    auto bytes = size_t{ 0 };
+    for (size_t i = 0; i < count; i++) {
+        bytes += static_cast<size_t>(inputs[i].size());
+        if (bytes >= batch_task_size && i + 1 < count) {
+            tasks.push_back(i + 1);
+            bytes = 0;
+        }
+    }
+    tasks.push_back(count);
+
+    // compute the digests in a single flat buffer
+    auto digests = buffer_t(count * len);
+    pool.parallel_for(tasks.size() - 1, [&](size_t t) {
+        auto h = hasher{ hash };
+        for (auto i = tasks[t]; i < tasks[t + 1]; i++) {
+            h.update(inputs[i]);
+            h.final(digests.data() + i * len);
+        }
+    });
+
+    auto result = std::vector<multihash>{};
+    result.reserve(count);
+    for (size_t i = 0; i < count; i++)
+        result.emplace_back(hash, type.code(), bufferview_t{ digests.data() + i * len, static_cast<ptrdiff_t>(len) }, details::verified);
+    return result;
+}
+
+std::vector<multihash> multiformats::compute_multihashes(hash_t hash, bufferview_t data, gsl::span<const size_t> boundaries, thread_pool& pool)
+{
+    auto chunks = std::vector<bufferview_t>{};
+    chunks.reserve(boundaries.size());
+
+    auto first = size_t{ 0 };
+    for (auto last : boundaries) {
+        if (last < first || last > static_cast<size_t>(data.size())) throw std::invalid_argument("Invalid chunk boundaries");
+        chunks.push_back(data.subspan(first, last - first));
+        first = last;
+    }
+
+    return compute_multihashes(hash, chunks, pool);
+}